@@ -0,0 +1,428 @@
+#include "../lib-header/cache.h"
+#include "../lib-header/stdmem.h"
+
+static struct BufferCacheState cache_state;
+static bool cache_initialized = FALSE;
+
+// Journal state, journal_sequence is sequence of newest slot on disk
+static struct JournalHeader journal_header;
+static uint32_t journal_lba;
+static uint32_t journal_sequence;
+static uint32_t journal_op_count;
+static bool     journal_attached = FALSE;
+static bool     journal_pending  = FALSE;
+
+static void cache_initialize(void) {
+    for (int i = 0; i < CACHE_HASH_BUCKET_COUNT; i++)
+        cache_state.hash_bucket[i] = CACHE_NO_LINE;
+
+    // All line start as invalid and linked into LRU list with arbitrary order
+    for (int i = 0; i < CACHE_LINE_COUNT; i++) {
+        cache_state.line[i].valid     = FALSE;
+        cache_state.line[i].dirty     = FALSE;
+        cache_state.line[i].logged    = FALSE;
+        cache_state.line[i].hash_next = CACHE_NO_LINE;
+        cache_state.line[i].lru_prev  = i - 1;
+        cache_state.line[i].lru_next  = (i == CACHE_LINE_COUNT - 1) ? CACHE_NO_LINE : i + 1;
+    }
+    cache_state.lru_head = 0;
+    cache_state.lru_tail = CACHE_LINE_COUNT - 1;
+    cache_initialized    = TRUE;
+}
+
+static uint32_t cache_hash(uint32_t line_lba) {
+    return (line_lba / CACHE_LINE_BLOCK_COUNT) % CACHE_HASH_BUCKET_COUNT;
+}
+
+static void lru_unlink(int16_t idx) {
+    struct CacheLine *line = &cache_state.line[idx];
+    if (line->lru_prev != CACHE_NO_LINE)
+        cache_state.line[line->lru_prev].lru_next = line->lru_next;
+    else
+        cache_state.lru_head = line->lru_next;
+    if (line->lru_next != CACHE_NO_LINE)
+        cache_state.line[line->lru_next].lru_prev = line->lru_prev;
+    else
+        cache_state.lru_tail = line->lru_prev;
+}
+
+// Move line into most recently used position
+static void lru_touch(int16_t idx) {
+    if (cache_state.lru_head == idx)
+        return;
+    lru_unlink(idx);
+    struct CacheLine *line = &cache_state.line[idx];
+    line->lru_prev = CACHE_NO_LINE;
+    line->lru_next = cache_state.lru_head;
+    cache_state.line[cache_state.lru_head].lru_prev = idx;
+    cache_state.lru_head = idx;
+}
+
+static void hash_remove(int16_t idx) {
+    uint32_t bucket = cache_hash(cache_state.line[idx].lba);
+    int16_t current = cache_state.hash_bucket[bucket];
+    if (current == idx) {
+        cache_state.hash_bucket[bucket] = cache_state.line[idx].hash_next;
+        return;
+    }
+    while (current != CACHE_NO_LINE) {
+        if (cache_state.line[current].hash_next == idx) {
+            cache_state.line[current].hash_next = cache_state.line[idx].hash_next;
+            return;
+        }
+        current = cache_state.line[current].hash_next;
+    }
+}
+
+static int16_t cache_lookup(uint32_t line_lba) {
+    int16_t idx = cache_state.hash_bucket[cache_hash(line_lba)];
+    while (idx != CACHE_NO_LINE) {
+        if (cache_state.line[idx].lba == line_lba)
+            return idx;
+        idx = cache_state.line[idx].hash_next;
+    }
+    return CACHE_NO_LINE;
+}
+
+// Invalidate line & make it next eviction victim
+static void cache_drop_line(int16_t idx) {
+    struct CacheLine *line = &cache_state.line[idx];
+    hash_remove(idx);
+    line->valid  = FALSE;
+    line->dirty  = FALSE;
+    line->logged = FALSE;
+    if (cache_state.lru_tail == idx)
+        return;
+    lru_unlink(idx);
+    line->lru_prev = cache_state.lru_tail;
+    line->lru_next = CACHE_NO_LINE;
+    cache_state.line[cache_state.lru_tail].lru_next = idx;
+    cache_state.lru_tail = idx;
+}
+
+static void cache_writeback(struct CacheLine *line) {
+    if (line->valid && line->dirty) {
+        write_blocks(line->buf, line->lba, CACHE_LINE_BLOCK_COUNT);
+        line->dirty = FALSE;
+        cache_state.stats.writeback++;
+    }
+}
+
+/* -- Journal -- */
+
+static uint32_t journal_slot_lba(uint32_t sequence) {
+    return journal_lba + (sequence % 2)*JOURNAL_SLOT_BLOCK_COUNT;
+}
+
+// FNV-1a continued from hash
+static uint32_t journal_checksum(uint32_t hash, const uint8_t *buf, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+        hash ^= buf[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+/**
+ * Log every dirty line into next slot, header is written last so torn commit leave
+ * older slot as newest valid one. Lines stay dirty until checkpoint or eviction
+ */
+static void journal_commit(void) {
+    bool has_unlogged = FALSE;
+    for (int i = 0; i < CACHE_LINE_COUNT; i++) {
+        if (cache_state.line[i].valid && cache_state.line[i].dirty && !cache_state.line[i].logged)
+            has_unlogged = TRUE;
+    }
+    if (!has_unlogged)
+        return;
+
+    uint32_t sequence = journal_sequence + 1;
+    uint32_t slot_lba = journal_slot_lba(sequence);
+    uint32_t count    = 0;
+    uint32_t checksum = 2166136261;
+    for (int i = 0; i < CACHE_LINE_COUNT; i++) {
+        struct CacheLine *line = &cache_state.line[i];
+        if (!line->valid || !line->dirty)
+            continue;
+        write_blocks(line->buf, slot_lba + (1 + count)*CACHE_LINE_BLOCK_COUNT, CACHE_LINE_BLOCK_COUNT);
+        checksum                  = journal_checksum(checksum, line->buf, CACHE_LINE_SIZE);
+        journal_header.lba[count] = line->lba;
+        count++;
+    }
+
+    journal_header.magic      = JOURNAL_MAGIC;
+    journal_header.sequence   = sequence;
+    journal_header.line_count = count;
+    journal_header.checksum   = checksum;
+    write_blocks(&journal_header, slot_lba, 1);
+
+    for (int i = 0; i < CACHE_LINE_COUNT; i++) {
+        if (cache_state.line[i].dirty)
+            cache_state.line[i].logged = TRUE;
+    }
+    journal_sequence = sequence;
+    journal_pending  = TRUE;
+    journal_op_count = 0;
+    cache_state.stats.commit++;
+}
+
+// Write every logged line into home location, then mark newest slot as nothing to replay
+static void journal_checkpoint(void) {
+    journal_commit();
+    for (int i = 0; i < CACHE_LINE_COUNT; i++)
+        cache_writeback(&cache_state.line[i]);
+    if (!journal_pending)
+        return;
+
+    memset(&journal_header, 0, sizeof(journal_header));
+    journal_header.magic    = JOURNAL_MAGIC;
+    journal_header.sequence = journal_sequence;
+    write_blocks(&journal_header, journal_slot_lba(journal_sequence), 1);
+    journal_pending = FALSE;
+}
+
+/**
+ * Get cache line containing line_lba, evicting least recently used line if not cached
+ *
+ * @param line_lba Line address, multiple of CACHE_LINE_BLOCK_COUNT
+ * @param fill     Read line content from disk on miss. Set FALSE if caller overwrite whole line
+ * @return         Cache line index
+ */
+static int16_t cache_get_line(uint32_t line_lba, bool fill) {
+    int16_t idx = cache_lookup(line_lba);
+    if (idx != CACHE_NO_LINE) {
+        cache_state.stats.hit++;
+        lru_touch(idx);
+        return idx;
+    }
+
+    cache_state.stats.miss++;
+    idx = cache_state.lru_tail;
+    struct CacheLine *line = &cache_state.line[idx];
+    if (line->valid) {
+        // Dirty line can only reach home location after its content is committed
+        if (journal_attached && line->dirty && !line->logged)
+            journal_commit();
+        cache_writeback(line);
+        hash_remove(idx);
+        cache_state.stats.eviction++;
+    }
+
+    line->lba   = line_lba;
+    line->valid  = TRUE;
+    line->dirty  = FALSE;
+    line->logged = FALSE;
+    if (fill)
+        read_blocks(line->buf, line_lba, CACHE_LINE_BLOCK_COUNT);
+
+    uint32_t bucket                 = cache_hash(line_lba);
+    line->hash_next                 = cache_state.hash_bucket[bucket];
+    cache_state.hash_bucket[bucket] = idx;
+    lru_touch(idx);
+    return idx;
+}
+
+/**
+ * Transfer block_count blocks directly with disk, split into read_blocks / write_blocks limit
+ */
+static void cache_direct_transfer(void *ptr, uint32_t logical_block_address, uint32_t block_count, bool is_write) {
+    uint8_t *buf = (uint8_t*) ptr;
+    while (block_count > 0) {
+        uint8_t count = block_count > 255 ? 255 : block_count;
+        if (is_write)
+            write_blocks(buf, logical_block_address, count);
+        else
+            read_blocks(buf, logical_block_address, count);
+        buf                   += count * BLOCK_SIZE;
+        logical_block_address += count;
+        block_count           -= count;
+    }
+}
+
+/**
+ * Transfer spanning multiple lines is issued to disk as single command instead of per line.
+ * Read populate missing lines that fully covered (unless bypass), resident dirty lines take precedence.
+ * Write is write-through, resident lines updated in place and keep their dirty flag.
+ * Resident line already logged is committed again before direct write, so replay never restore older image over it.
+ */
+static void cache_multi_line_transfer(void *ptr, uint32_t logical_block_address, uint32_t block_count, bool is_write) {
+    uint8_t *buf        = (uint8_t*) ptr;
+    uint32_t end_lba    = logical_block_address + block_count;
+    uint32_t first_line = logical_block_address - logical_block_address % CACHE_LINE_BLOCK_COUNT;
+    bool bypass         = block_count > CACHE_BYPASS_LINE_COUNT*CACHE_LINE_BLOCK_COUNT;
+    if (bypass)
+        cache_state.stats.bypass++;
+
+    if (!is_write)
+        cache_direct_transfer(ptr, logical_block_address, block_count, FALSE);
+    bool relog = FALSE;
+    for (uint32_t line_lba = first_line; line_lba < end_lba; line_lba += CACHE_LINE_BLOCK_COUNT) {
+        uint32_t from   = line_lba < logical_block_address ? logical_block_address : line_lba;
+        uint32_t to     = line_lba + CACHE_LINE_BLOCK_COUNT > end_lba ? end_lba : line_lba + CACHE_LINE_BLOCK_COUNT;
+        uint8_t *data   = buf + (from - logical_block_address) * BLOCK_SIZE;
+        uint32_t offset = (from - line_lba) * BLOCK_SIZE;
+        uint32_t size   = (to - from) * BLOCK_SIZE;
+
+        int16_t idx = cache_lookup(line_lba);
+        if (idx != CACHE_NO_LINE) {
+            struct CacheLine *line = &cache_state.line[idx];
+            if (is_write) {
+                memcpy(line->buf + offset, data, size);
+                relog        = relog || (line->dirty && line->logged);
+                line->logged = FALSE;
+            }
+            else if (line->dirty)
+                memcpy(data, line->buf + offset, size);
+        } else if (!is_write && !bypass && size == CACHE_LINE_SIZE) {
+            idx = cache_get_line(line_lba, FALSE);
+            memcpy(cache_state.line[idx].buf, data, CACHE_LINE_SIZE);
+        }
+    }
+    if (is_write) {
+        if (relog && journal_attached)
+            journal_commit();
+        cache_direct_transfer(ptr, logical_block_address, block_count, TRUE);
+    }
+}
+
+void cache_read_blocks(void *ptr, uint32_t logical_block_address, uint32_t block_count) {
+    if (!cache_initialized)
+        cache_initialize();
+
+    uint32_t line_offset = logical_block_address % CACHE_LINE_BLOCK_COUNT;
+    if (line_offset + block_count > CACHE_LINE_BLOCK_COUNT) {
+        cache_multi_line_transfer(ptr, logical_block_address, block_count, FALSE);
+        return;
+    }
+
+    int16_t idx = cache_get_line(logical_block_address - line_offset, TRUE);
+    memcpy(ptr, cache_state.line[idx].buf + line_offset * BLOCK_SIZE, block_count * BLOCK_SIZE);
+}
+
+void cache_write_blocks(const void *ptr, uint32_t logical_block_address, uint32_t block_count) {
+    if (!cache_initialized)
+        cache_initialize();
+
+    uint32_t line_offset = logical_block_address % CACHE_LINE_BLOCK_COUNT;
+    if (line_offset + block_count > CACHE_LINE_BLOCK_COUNT) {
+        cache_multi_line_transfer((void*) ptr, logical_block_address, block_count, TRUE);
+        return;
+    }
+
+    bool full_line = block_count == CACHE_LINE_BLOCK_COUNT;
+    int16_t idx    = cache_get_line(logical_block_address - line_offset, !full_line);
+    memcpy(cache_state.line[idx].buf + line_offset * BLOCK_SIZE, ptr, block_count * BLOCK_SIZE);
+    cache_state.line[idx].dirty  = TRUE;
+    cache_state.line[idx].logged = FALSE;
+}
+
+uint8_t* cache_get_block(uint32_t logical_block_address, bool will_modify) {
+    if (!cache_initialized)
+        cache_initialize();
+
+    uint32_t line_offset = logical_block_address % CACHE_LINE_BLOCK_COUNT;
+    int16_t idx          = cache_get_line(logical_block_address - line_offset, TRUE);
+    if (will_modify) {
+        cache_state.line[idx].dirty  = TRUE;
+        cache_state.line[idx].logged = FALSE;
+    }
+    return cache_state.line[idx].buf + line_offset * BLOCK_SIZE;
+}
+
+void cache_discard_blocks(uint32_t logical_block_address, uint32_t block_count) {
+    if (!cache_initialized)
+        return;
+    uint32_t end_lba  = logical_block_address + block_count;
+    uint32_t line_lba = logical_block_address + (CACHE_LINE_BLOCK_COUNT - logical_block_address % CACHE_LINE_BLOCK_COUNT) % CACHE_LINE_BLOCK_COUNT;
+    for (; line_lba + CACHE_LINE_BLOCK_COUNT <= end_lba; line_lba += CACHE_LINE_BLOCK_COUNT) {
+        int16_t idx = cache_lookup(line_lba);
+        if (idx != CACHE_NO_LINE)
+            cache_drop_line(idx);
+    }
+}
+
+void cache_zero_blocks(uint32_t logical_block_address, uint32_t block_count) {
+    static uint8_t zero_line[CACHE_LINE_SIZE];
+    cache_discard_blocks(logical_block_address, block_count);
+    for (uint32_t i = 0; i < block_count; i += CACHE_LINE_BLOCK_COUNT)
+        write_blocks(zero_line, logical_block_address + i, CACHE_LINE_BLOCK_COUNT);
+}
+
+void cache_sync(void) {
+    if (!cache_initialized)
+        return;
+    if (journal_attached) {
+        journal_checkpoint();
+        return;
+    }
+    for (int i = 0; i < CACHE_LINE_COUNT; i++)
+        cache_writeback(&cache_state.line[i]);
+}
+
+void cache_commit(bool force) {
+    if (!cache_initialized)
+        return;
+    if (!journal_attached) {
+        cache_sync();
+        return;
+    }
+
+    uint32_t dirty_count = 0;
+    for (int i = 0; i < CACHE_LINE_COUNT; i++) {
+        if (cache_state.line[i].valid && cache_state.line[i].dirty)
+            dirty_count++;
+    }
+    journal_op_count++;
+    if (dirty_count >= JOURNAL_CHECKPOINT_LINE_COUNT)
+        journal_checkpoint();
+    else if (force || journal_op_count >= JOURNAL_GROUP_OP_COUNT)
+        journal_commit();
+}
+
+void cache_journal_attach(uint32_t logical_block_address) {
+    if (!cache_initialized)
+        cache_initialize();
+    cache_sync();
+    journal_lba = logical_block_address;
+
+    // Pick newest slot with valid header
+    bool found = FALSE;
+    for (uint32_t slot = 0; slot < 2; slot++) {
+        read_blocks(&journal_header, journal_lba + slot*JOURNAL_SLOT_BLOCK_COUNT, 1);
+        if (journal_header.magic != JOURNAL_MAGIC || journal_header.sequence % 2 != slot)
+            continue;
+        if (!found || journal_header.sequence > journal_sequence) {
+            journal_sequence = journal_header.sequence;
+            found            = TRUE;
+        }
+    }
+    if (!found)
+        journal_sequence = 0;
+
+    // Replay, line buffers are used as scratch since every line is dropped afterward
+    uint32_t slot_lba = journal_slot_lba(journal_sequence);
+    read_blocks(&journal_header, slot_lba, 1);
+    if (found && journal_header.line_count > 0 && journal_header.line_count <= JOURNAL_LINE_COUNT) {
+        uint32_t count    = journal_header.line_count;
+        uint32_t checksum = 2166136261;
+        for (uint32_t i = 0; i < count; i++) {
+            read_blocks(cache_state.line[i].buf, slot_lba + (1 + i)*CACHE_LINE_BLOCK_COUNT, CACHE_LINE_BLOCK_COUNT);
+            checksum = journal_checksum(checksum, cache_state.line[i].buf, CACHE_LINE_SIZE);
+        }
+        if (checksum == journal_header.checksum) {
+            for (uint32_t i = 0; i < count; i++)
+                write_blocks(cache_state.line[i].buf, journal_header.lba[i], CACHE_LINE_BLOCK_COUNT);
+            cache_state.stats.replay += count;
+        }
+    }
+    cache_initialize();
+
+    journal_attached = TRUE;
+    journal_pending  = TRUE;
+    journal_op_count = 0;
+    journal_checkpoint();
+}
+
+struct CacheStats cache_get_stats(void) {
+    return cache_state.stats;
+}
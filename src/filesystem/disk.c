@@ -1,5 +1,21 @@
 #include "lib-header/disk.h"
 #include "lib-header/portio.h"
+#include "lib-header/stdmem.h"
+#include "lib-header/interrupt.h"
+#include "lib-header/paging.h"
+
+static struct ATADriverState ata_state = {
+    .dma_enabled     = FALSE,
+    .bus_master_base = 0,
+    .queue_head      = 0,
+    .queue_tail      = 0,
+    .pio_block_index = 0,
+    .block_count     = 0,
+};
+
+// Bounce buffer for DMA, aligned so every PRD region never cross 64 KiB boundary
+static uint8_t dma_buffer[ATA_DMA_BUFFER_SIZE] __attribute__((aligned(ATA_DMA_BOUNDARY)));
+static struct PhysicalRegionDescriptor dma_prdt[ATA_DMA_PRD_COUNT] __attribute__((aligned(16)));
 
 static void ATA_busy_wait() {
     while (in(0x1F7) & ATA_STATUS_BSY);
@@ -9,40 +25,228 @@ static void ATA_DRQ_wait() {
     while (!(in(0x1F7) & ATA_STATUS_RDY));
 }
 
-/**
- * ATA PIO logical block address read blocks. Will blocking until read is completed.
- * Note: ATA PIO will use 2-bytes per read/write operation.
- * Recommended to use struct BlockBuffer
- * 
- * @param ptr                   Pointer for storing reading data, this pointer should point to already allocated memory location.
- *                              With allocated size positive integer multiple of BLOCK_SIZE, ex: buf[1024]
- * @param logical_block_address Block address to read data from. Use LBA addressing
- * @param block_count           How many block to read, starting from block logical_block_address to lba-1
- */
-void read_blocks(void *ptr, uint32_t logical_block_address, uint8_t block_count) {
+static void ATA_send_command(uint32_t logical_block_address, uint8_t block_count, uint8_t command) {
     ATA_busy_wait();
     out(0x1F6, 0xE0 | ((logical_block_address >> 24) & 0xF));
     out(0x1F2, block_count);
     out(0x1F3, (uint8_t) logical_block_address);
     out(0x1F4, (uint8_t) (logical_block_address >> 8));
     out(0x1F5, (uint8_t) (logical_block_address >> 16));
-    out(0x1F7, 0x20);
+    out(0x1F7, command);
+}
+
+static uint32_t pci_config_read(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    out32(PCI_CONFIG_ADDRESS, 0x80000000 | bus << 16 | slot << 11 | func << 8 | (offset & 0xFC));
+    return in32(PCI_CONFIG_DATA);
+}
+
+static void pci_config_write(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value) {
+    out32(PCI_CONFIG_ADDRESS, 0x80000000 | bus << 16 | slot << 11 | func << 8 | (offset & 0xFC));
+    out32(PCI_CONFIG_DATA, value);
+}
+
+// Setup PRD table & bounce buffer, then start bus-master engine. Completion raised with IRQ14
+static void ATA_DMA_start(struct BlockRequest *request) {
+    uint16_t bm_base   = ata_state.bus_master_base;
+    uint32_t byte_size = request->block_count * BLOCK_SIZE;
+    uint32_t phys_addr = (uint32_t) dma_buffer - KERNEL_VIRTUAL_BASE;
 
-    uint16_t *target = (uint16_t*) ptr;
+    // Split bounce buffer into PRD region per 64 KiB
+    uint8_t prd_count = 0;
+    for (uint32_t offset = 0; offset < byte_size; offset += ATA_DMA_BOUNDARY) {
+        uint32_t region_size = byte_size - offset;
+        if (region_size > ATA_DMA_BOUNDARY)
+            region_size = ATA_DMA_BOUNDARY;
+        dma_prdt[prd_count].physical_addr = phys_addr + offset;
+        dma_prdt[prd_count].byte_count    = (uint16_t) region_size;
+        dma_prdt[prd_count].flag          = 0;
+        prd_count++;
+    }
+    dma_prdt[prd_count - 1].flag = PRD_END_OF_TABLE;
+
+    if (request->is_write)
+        memcpy(dma_buffer, request->buf, byte_size);
+
+    // Stop engine, load PRDT, and clear error & interrupt bit (write 1 to clear)
+    out(bm_base + BM_REG_COMMAND, 0);
+    out32(bm_base + BM_REG_PRDT, (uint32_t) dma_prdt - KERNEL_VIRTUAL_BASE);
+    out(bm_base + BM_REG_STATUS, in(bm_base + BM_REG_STATUS) | BM_STATUS_ERROR | BM_STATUS_INTERRUPT);
+
+    uint8_t command = request->is_write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA;
+    ATA_send_command(request->logical_block_address, request->block_count, command);
+    out(bm_base + BM_REG_COMMAND, BM_COMMAND_START | (request->is_write ? 0 : BM_COMMAND_READ));
+}
 
-    for (uint32_t i = 0; i < block_count; i++) {
-        ATA_busy_wait();
-        ATA_DRQ_wait();
+// Write single block of in-flight PIO write request, disk will raise IRQ14 after block is written
+static void ATA_PIO_write_next_block(struct BlockRequest *request) {
+    uint16_t *source = (uint16_t*) request->buf + HALF_BLOCK_SIZE*ata_state.pio_block_index;
+    ATA_busy_wait();
+    ATA_DRQ_wait();
+    for (uint32_t j = 0; j < HALF_BLOCK_SIZE; j++)
+        out16(0x1F0, source[j]);
+}
+
+static void ATA_start_request(struct BlockRequest *request) {
+    ata_state.pio_block_index = 0;
+    if (ata_state.dma_enabled) {
+        ATA_DMA_start(request);
+    } else if (request->is_write) {
+        ATA_send_command(request->logical_block_address, request->block_count, ATA_CMD_WRITE_PIO);
+        ATA_PIO_write_next_block(request);
+    } else {
+        ATA_send_command(request->logical_block_address, request->block_count, ATA_CMD_READ_PIO);
+    }
+}
+
+// Pop in-flight request from queue, notify submitter, and start next request
+static void ATA_complete_request(int8_t status) {
+    struct BlockRequest *request = ata_state.queue_head;
+    ata_state.queue_head = request->next;
+    if (ata_state.queue_head == 0)
+        ata_state.queue_tail = 0;
+
+    request->status = status;
+    request->done   = TRUE;
+    if (request->callback)
+        request->callback(request);
+
+    if (ata_state.queue_head)
+        ATA_start_request(ata_state.queue_head);
+}
+
+static void ATA_DMA_handle_interrupt(struct BlockRequest *request, uint8_t ata_status) {
+    uint16_t bm_base  = ata_state.bus_master_base;
+    uint8_t bm_status = in(bm_base + BM_REG_STATUS);
+    if (!(bm_status & BM_STATUS_INTERRUPT))
+        return;
+
+    out(bm_base + BM_REG_COMMAND, 0);
+    out(bm_base + BM_REG_STATUS, bm_status | BM_STATUS_ERROR | BM_STATUS_INTERRUPT);
+    if ((bm_status & BM_STATUS_ERROR) || (ata_status & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+        // Retry same request with PIO, DMA will not be used anymore
+        ata_state.dma_enabled = FALSE;
+        ATA_start_request(request);
+        return;
+    }
+
+    if (!request->is_write)
+        memcpy(request->buf, dma_buffer, request->block_count * BLOCK_SIZE);
+    ATA_complete_request(BLOCK_REQUEST_SUCCESS);
+}
+
+static void ATA_PIO_handle_interrupt(struct BlockRequest *request, uint8_t ata_status) {
+    if (ata_status & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+        ATA_complete_request(BLOCK_REQUEST_ERROR);
+        return;
+    }
+
+    if (!request->is_write) {
+        uint16_t *target = (uint16_t*) request->buf + HALF_BLOCK_SIZE*ata_state.pio_block_index;
         for (uint32_t j = 0; j < HALF_BLOCK_SIZE; j++)
             target[j] = in16(0x1F0);
-        // Note : uint16_t => 2 bytes, HALF_BLOCK_SIZE*2 = BLOCK_SIZE with pointer arithmetic
-        target += HALF_BLOCK_SIZE;
     }
+
+    ata_state.pio_block_index++;
+    if (ata_state.pio_block_index == request->block_count)
+        ATA_complete_request(BLOCK_REQUEST_SUCCESS);
+    else if (request->is_write)
+        ATA_PIO_write_next_block(request);
+}
+
+void submit_block_request(struct BlockRequest *request) {
+    request->done   = FALSE;
+    request->status = BLOCK_REQUEST_SUCCESS;
+    request->next   = 0;
+    if (request->block_count == 0) {
+        request->done = TRUE;
+        if (request->callback)
+            request->callback(request);
+        return;
+    }
+
+    // Queue is shared with ata_isr(), keep IRQ14 out while linking request
+    uint32_t eflags;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(eflags) : /* <Empty> */ : "memory");
+    if (ata_state.queue_head == 0) {
+        ata_state.queue_head = request;
+        ata_state.queue_tail = request;
+        ATA_start_request(request);
+    } else {
+        ata_state.queue_tail->next = request;
+        ata_state.queue_tail       = request;
+    }
+    __asm__ volatile("push %0; popf" : /* <Empty> */ : "r"(eflags) : "memory", "cc");
+}
+
+// In-flight request lost its IRQ14, reset drive then retry DMA request with PIO or fail PIO request. Called with interrupt disabled
+static void ATA_handle_timeout(void) {
+    struct BlockRequest *request = ata_state.queue_head;
+    if (request == 0)
+        return;
+
+    if (ata_state.dma_enabled) {
+        uint16_t bm_base = ata_state.bus_master_base;
+        out(bm_base + BM_REG_COMMAND, 0);
+        out(bm_base + BM_REG_STATUS, in(bm_base + BM_REG_STATUS) | BM_STATUS_ERROR | BM_STATUS_INTERRUPT);
+    }
+    out(ATA_CONTROL_PORT, ATA_CONTROL_SRST);
+    for (uint8_t i = 0; i < 4; i++)
+        in(ATA_CONTROL_PORT);
+    out(ATA_CONTROL_PORT, 0);
+
+    if (ata_state.dma_enabled) {
+        ata_state.dma_enabled = FALSE;
+        ATA_start_request(request);
+    } else {
+        ATA_complete_request(BLOCK_REQUEST_ERROR);
+    }
+}
+
+void wait_block_request(struct BlockRequest *request) {
+    uint32_t eflags;
+    __asm__ volatile("pushf; pop %0" : "=r"(eflags) : /* <Empty> */ : "memory");
+    // No timer interrupt to bound hlt, poll with interrupt window instead so lost IRQ14 can be detected
+    uint32_t timeout = ATA_REQUEST_TIMEOUT;
+    while (TRUE) {
+        __asm__ volatile("cli" : : : "memory");
+        if (request->done)
+            break;
+        if (--timeout == 0) {
+            ATA_handle_timeout();
+            timeout = ATA_REQUEST_TIMEOUT;
+            continue;
+        }
+        // sti take effect after next instruction, pending IRQ14 is serviced right after pause
+        __asm__ volatile("sti; pause" : : : "memory");
+    }
+    __asm__ volatile("push %0; popf" : /* <Empty> */ : "r"(eflags) : "memory", "cc");
+}
+
+/**
+ * ATA logical block address read blocks. Will blocking until read is completed.
+ * Note: Synchronous wrapper for submit_block_request(), use DMA if available, else PIO.
+ * Recommended to use struct BlockBuffer
+ * 
+ * @param ptr                   Pointer for storing reading data, this pointer should point to already allocated memory location.
+ *                              With allocated size positive integer multiple of BLOCK_SIZE, ex: buf[1024]
+ * @param logical_block_address Block address to read data from. Use LBA addressing
+ * @param block_count           How many block to read, starting from block logical_block_address to lba-1
+ */
+void read_blocks(void *ptr, uint32_t logical_block_address, uint8_t block_count) {
+    struct BlockRequest request = {
+        .buf                   = ptr,
+        .logical_block_address = logical_block_address,
+        .block_count           = block_count,
+        .is_write              = FALSE,
+        .callback              = 0,
+    };
+    submit_block_request(&request);
+    wait_block_request(&request);
 }
 
 /**
- * ATA PIO logical block address write blocks. Will blocking until write is completed.
- * Note: ATA PIO will use 2-bytes per read/write operation.
+ * ATA logical block address write blocks. Will blocking until write is completed.
+ * Note: Synchronous wrapper for submit_block_request(), use DMA if available, else PIO.
  * Recommended to use struct BlockBuffer
  *
  * @param ptr                   Pointer to data that to be written into disk. Memory pointed should be positive integer multiple of BLOCK_SIZE
@@ -50,21 +254,87 @@ void read_blocks(void *ptr, uint32_t logical_block_address, uint8_t block_count)
  * @param block_count           How many block to write, starting from block logical_block_address to lba-1
  */
 void write_blocks(const void *ptr, uint32_t logical_block_address, uint8_t block_count) {
+    struct BlockRequest request = {
+        .buf                   = (void*) ptr,
+        .logical_block_address = logical_block_address,
+        .block_count           = block_count,
+        .is_write              = TRUE,
+        .callback              = 0,
+    };
+    submit_block_request(&request);
+    wait_block_request(&request);
+}
+
+// Run ATA IDENTIFY with polling, disk queue must be idle. Words 60-61 contain LBA28 block count
+static void ATA_identify(void) {
+    out(0x1F6, 0xA0);
+    out(0x1F2, 0);
+    out(0x1F3, 0);
+    out(0x1F4, 0);
+    out(0x1F5, 0);
+    out(0x1F7, ATA_CMD_IDENTIFY);
+    // 0 mean no drive, 0xFF is floating bus without controller (BSY would never clear)
+    uint8_t identify_status = in(0x1F7);
+    if (identify_status == 0 || identify_status == 0xFF)
+        return;
+
     ATA_busy_wait();
-    out(0x1F6, 0xE0 | ((logical_block_address >> 24) & 0xF));
-    out(0x1F2, block_count);
-    out(0x1F3, (uint8_t) logical_block_address);
-    out(0x1F4, (uint8_t) (logical_block_address >> 8));
-    out(0x1F5, (uint8_t) (logical_block_address >> 16));
-    out(0x1F7, 0x30);
-
-    for (uint32_t i = 0; i < block_count; i++) {
-        ATA_busy_wait();
-        ATA_DRQ_wait();
-        /* Note : uint16_t => 2 bytes, i is current block number to write
-           HALF_BLOCK_SIZE*i = block_offset with pointer arithmetic
-        */
-        for (uint32_t j = 0; j < HALF_BLOCK_SIZE; j++)
-            out16(0x1F0, ((uint16_t*) ptr)[HALF_BLOCK_SIZE*i + j]);
+    uint8_t status;
+    do {
+        status = in(0x1F7);
+    } while (!(status & (ATA_STATUS_DRQ | ATA_STATUS_ERR)));
+    if (status & ATA_STATUS_ERR)
+        return;
+
+    uint16_t identify[HALF_BLOCK_SIZE];
+    for (uint32_t j = 0; j < HALF_BLOCK_SIZE; j++)
+        identify[j] = in16(0x1F0);
+    ata_state.block_count = identify[60] | ((uint32_t) identify[61] << 16);
+}
+
+uint32_t get_disk_block_count(void) {
+    return ata_state.block_count;
+}
+
+void initialize_disk(void) {
+    ATA_identify();
+
+    for (uint16_t bus = 0; bus < 256; bus++) {
+        for (uint8_t slot = 0; slot < 32; slot++) {
+            for (uint8_t func = 0; func < 8; func++) {
+                uint32_t id = pci_config_read(bus, slot, func, 0x00);
+                if ((id & 0xFFFF) == 0xFFFF)
+                    continue;
+
+                // Class register: class [31:24], subclass [23:16], prog IF [15:8]
+                uint32_t class_reg = pci_config_read(bus, slot, func, 0x08);
+                bool is_ide        = (class_reg >> 24) == PCI_CLASS_MASS_STORAGE
+                                        && ((class_reg >> 16) & 0xFF) == PCI_SUBCLASS_IDE;
+                bool is_bus_master = (class_reg >> 8) & 0x80;
+                uint32_t bar4      = pci_config_read(bus, slot, func, 0x20);
+                if (!is_ide || !is_bus_master || !(bar4 & 1))
+                    continue;
+
+                uint32_t command = pci_config_read(bus, slot, func, 0x04);
+                pci_config_write(bus, slot, func, 0x04, command | PCI_COMMAND_IO_SPACE | PCI_COMMAND_BUS_MASTER);
+
+                ata_state.bus_master_base = (uint16_t) (bar4 & 0xFFFC);
+                ata_state.dma_enabled     = TRUE;
+                return;
+            }
+        }
+    }
+}
+
+void ata_isr(void) {
+    // Reading status register acknowledge disk interrupt
+    uint8_t ata_status           = in(0x1F7);
+    struct BlockRequest *request = ata_state.queue_head;
+    if (request) {
+        if (ata_state.dma_enabled)
+            ATA_DMA_handle_interrupt(request, ata_status);
+        else
+            ATA_PIO_handle_interrupt(request, ata_status);
     }
+    pic_ack(IRQ_PRIMARY_ATA);
 }
@@ -1,6 +1,8 @@
 #include "../lib-header/stdtype.h"
 #include "../lib-header/fat32.h"
 #include "../lib-header/stdmem.h"
+#include "../lib-header/cache.h"
+#include "../lib-header/heap.h"
 
 const uint8_t fs_signature[BLOCK_SIZE] = {
     'S', 't', 'r', 'e', 's', 's', ' ', 'T', 'u', 'b', 'e', 's', ' ', ' ', ' ',  ' ',
@@ -13,9 +15,14 @@ const uint8_t fs_signature[BLOCK_SIZE] = {
 };
 
 struct FAT32DriverState driver_state;
+
+// Cluster size of volume created by create_fat32()
+static uint32_t format_cluster_block_count = CLUSTER_DEFAULT_BLOCK_COUNT;
+
+// Never written, source of every zero fill
+static struct ClusterBuffer zero_cluster;
 struct FAT32DriverRequest driver_request;
 
-#define EOF -1
 
 /**
  * Convert cluster number to logical block address
@@ -49,46 +56,245 @@ void init_directory_table(struct FAT32DirectoryTable *dir_table, char *name, uin
  */
 bool is_empty_storage(void){
     struct BlockBuffer temp;
-    read_blocks(temp.buf, BOOT_SECTOR, 1);
+    cache_read_blocks(temp.buf, BOOT_SECTOR, 1);
     return (memcmp(fs_signature, temp.buf, BLOCK_SIZE) != 0);
 }
 
+// Set volume geometry on driver state, FAT page 1 onward placed contiguously from FIRST_DATA_CLUSTER_NUMBER
+static void set_volume_geometry(uint32_t cluster_count) {
+    if (cluster_count > FAT32_MAX_CLUSTER_COUNT)
+        cluster_count = FAT32_MAX_CLUSTER_COUNT;
+    driver_state.cluster_count         = cluster_count;
+    driver_state.fat_cluster_count     = (cluster_count + FAT_ENTRY_PER_CLUSTER - 1) / FAT_ENTRY_PER_CLUSTER;
+    driver_state.fat_extension_cluster = FIRST_DATA_CLUSTER_NUMBER;
+}
+
+// Logical block address containing FAT entry of cluster
+static uint32_t fat_entry_lba(uint32_t cluster) {
+    uint32_t page         = cluster / FAT_ENTRY_PER_CLUSTER;
+    uint32_t page_cluster = page == 0 ? FAT_CLUSTER_NUMBER : driver_state.fat_extension_cluster + page - 1;
+    return cluster_to_lba(page_cluster) + (cluster % FAT_ENTRY_PER_CLUSTER) / FAT_ENTRY_PER_BLOCK;
+}
+
+uint32_t get_fat_entry(uint32_t cluster) {
+    uint32_t *entry_block = (uint32_t*) cache_get_block(fat_entry_lba(cluster), FALSE);
+    return entry_block[cluster % FAT_ENTRY_PER_BLOCK];
+}
+
+void set_fat_entry(uint32_t cluster, uint32_t value) {
+    uint32_t *entry_block = (uint32_t*) cache_get_block(fat_entry_lba(cluster), TRUE);
+    entry_block[cluster % FAT_ENTRY_PER_BLOCK] = value;
+}
+
 /**
  * Create new FAT32 file system. Will write fs_signature into boot sector and 
  * proper FileAllocationTable (contain CLUSTER_0_VALUE, CLUSTER_1_VALUE, 
- * and initialized root directory) into cluster number 1
+ * and initialized root directory) into cluster number 1.
+ * FAT size follow disk capacity from get_disk_block_count(), capped at FAT32_MAX_CLUSTER_COUNT
  */
 void create_fat32(void){
-    
-    struct FAT32FileAllocationTable table = {0};
-    table.cluster_map[0] = CLUSTER_0_VALUE;
-    table.cluster_map[1] = CLUSTER_1_VALUE;
-    table.cluster_map[2] = FAT32_FAT_END_OF_FILE;
+    driver_state.cluster_block_count = format_cluster_block_count;
+    uint32_t disk_cluster_count = get_disk_block_count() / CLUSTER_BLOCK_COUNT;
+    bool     use_disk_size      = disk_cluster_count >= 2*CLUSTER_MAP_SIZE || CLUSTER_BLOCK_COUNT != CLUSTER_DEFAULT_BLOCK_COUNT;
+    set_volume_geometry(use_disk_size ? disk_cluster_count : CLUSTER_MAP_SIZE);
+    driver_state.zero_policy = ZERO_POLICY_LAZY;
 
+    // Empty every FAT page
+    write_clusters(zero_cluster.buf, FAT_CLUSTER_NUMBER, 1);
+    for (uint32_t i = 1; i < driver_state.fat_cluster_count; i++)
+        write_clusters(zero_cluster.buf, driver_state.fat_extension_cluster + i - 1, 1);
 
-    // write FAT cluster map to cluster number 1
-    write_clusters(table.cluster_map, FAT_CLUSTER_NUMBER, 1);
+    set_fat_entry(0, CLUSTER_0_VALUE);
+    set_fat_entry(1, CLUSTER_1_VALUE);
+    set_fat_entry(2, FAT32_FAT_END_OF_FILE);
+    for (uint32_t i = 1; i < driver_state.fat_cluster_count; i++)
+        set_fat_entry(driver_state.fat_extension_cluster + i - 1, FAT32_FAT_END_OF_FILE);
     
     // write fs_signature into boot sector
-    write_blocks(fs_signature, BOOT_SECTOR, 1);
+    cache_write_blocks(fs_signature, BOOT_SECTOR, 1);
+}
+
+int8_t set_format_cluster_size(uint32_t cluster_size) {
+    uint32_t block_count = cluster_size / BLOCK_SIZE;
+    bool is_power_of_two = block_count != 0 && (block_count & (block_count - 1)) == 0;
+    if (cluster_size % BLOCK_SIZE != 0 || !is_power_of_two
+            || block_count < CLUSTER_MIN_BLOCK_COUNT || block_count > CLUSTER_MAX_BLOCK_COUNT) {
+        return -1;
+    }
+    format_cluster_block_count = block_count;
+    return 0;
+}
+
+// Load volume geometry from FSInfo, volume without geometry use single FAT page
+static void read_volume_geometry(void) {
+    struct FAT32FSInfo fsinfo;
+    cache_read_blocks(&fsinfo, FSINFO_SECTOR, 1);
+    if (fsinfo.lead_signature == FSINFO_LEAD_SIGNATURE && fsinfo.cluster_count != 0) {
+        driver_state.cluster_block_count   = fsinfo.cluster_block_count != 0 ? fsinfo.cluster_block_count : CLUSTER_DEFAULT_BLOCK_COUNT;
+        driver_state.cluster_count         = fsinfo.cluster_count;
+        driver_state.fat_cluster_count     = fsinfo.fat_cluster_count;
+        driver_state.fat_extension_cluster = fsinfo.fat_extension_cluster;
+        driver_state.index_root_cluster    = fsinfo.index_root_cluster;
+        driver_state.refcount_cluster      = fsinfo.refcount_cluster;
+        driver_state.journal_cluster       = fsinfo.journal_cluster;
+        driver_state.zero_policy           = fsinfo.zero_policy;
+        driver_state.tail_cluster          = fsinfo.tail_cluster;
+    } else {
+        driver_state.cluster_block_count = CLUSTER_DEFAULT_BLOCK_COUNT;
+        set_volume_geometry(CLUSTER_MAP_SIZE);
+        driver_state.zero_policy = ZERO_POLICY_EAGER;
+    }
+}
+
+static bool is_cluster_free(uint32_t cluster) {
+    return (driver_state.free_cluster_bitmap[cluster / 32] >> (cluster % 32)) & 1;
+}
+
+static bool is_cluster_scrub_pending(uint32_t cluster) {
+    return (driver_state.scrub_cluster_bitmap[cluster / 32] >> (cluster % 32)) & 1;
+}
+
+// Zero reallocated cluster with pending scrub, partial write & tail allocation does not overwrite whole cluster
+static void clear_cluster_scrub(uint32_t cluster) {
+    if (is_cluster_scrub_pending(cluster)) {
+        cache_zero_blocks(cluster_to_lba(cluster), CLUSTER_BLOCK_COUNT);
+        driver_state.scrub_cluster_bitmap[cluster / 32] &= ~(1u << (cluster % 32));
+        driver_state.scrub_cluster_count--;
+    }
+}
+
+/**
+ * Commit pending free before any cluster is reused. Freed cluster may still belong to a file
+ * that replay would bring back, and reused cluster can be written directly into disk bypassing journal
+ */
+static void commit_uncommitted_free(void) {
+    if (!driver_state.free_uncommitted)
+        return;
+    if (driver_state.journal_cluster != 0 && cache_get_stats().commit == driver_state.free_commit_stamp)
+        cache_commit(TRUE);
+    driver_state.free_uncommitted = FALSE;
+}
+
+// Set FAT entry of free cluster and remove it from free cluster bitmap
+static void mark_cluster_used(uint32_t cluster, uint32_t fat_value) {
+    if (is_cluster_free(cluster)) {
+        commit_uncommitted_free();
+        driver_state.free_cluster_bitmap[cluster / 32] &= ~(1u << (cluster % 32));
+        driver_state.free_cluster_count--;
+        clear_cluster_scrub(cluster);
+    }
+    set_fat_entry(cluster, fat_value);
+}
+
+// Add cluster into free cluster bitmap & update free hint, FAT is untouched
+static void set_cluster_free_bit(uint32_t cluster) {
+    driver_state.free_cluster_bitmap[cluster / 32] |= 1u << (cluster % 32);
+    driver_state.free_cluster_count++;
+    if (cluster < driver_state.next_free_cluster)
+        driver_state.next_free_cluster = cluster;
+}
+
+// Empty FAT entry and return cluster into free cluster bitmap
+static void mark_cluster_free(uint32_t cluster) {
+    set_fat_entry(cluster, FAT32_FAT_EMPTY_ENTRY);
+    if (cluster >= FIRST_DATA_CLUSTER_NUMBER && !is_cluster_free(cluster)) {
+        set_cluster_free_bit(cluster);
+        if (!driver_state.free_uncommitted) {
+            driver_state.free_uncommitted  = TRUE;
+            driver_state.free_commit_stamp = cache_get_stats().commit;
+        }
+    }
+}
+
+// Build free cluster bitmap & counter from FAT, single pass over FAT. FAT is only read, no page is dirtied
+static void build_free_cluster_bitmap(void) {
+    memset(driver_state.free_cluster_bitmap, 0, sizeof(driver_state.free_cluster_bitmap));
+    memset(driver_state.scrub_cluster_bitmap, 0, sizeof(driver_state.scrub_cluster_bitmap));
+    driver_state.free_cluster_count  = 0;
+    driver_state.scrub_cluster_count = 0;
+    driver_state.next_free_cluster   = driver_state.cluster_count;
+    driver_state.free_uncommitted    = FALSE;
+    for (uint32_t i = FIRST_DATA_CLUSTER_NUMBER; i < driver_state.cluster_count; i++) {
+        if (get_fat_entry(i) == FAT32_FAT_EMPTY_ENTRY)
+            set_cluster_free_bit(i);
+    }
+}
+
+// Write FSInfo (geometry & free cluster hint) into storage, modified FAT page already dirty in cache
+static void write_fsinfo(void) {
+    struct FAT32FSInfo fsinfo = {
+        .lead_signature        = FSINFO_LEAD_SIGNATURE,
+        .cluster_count         = driver_state.cluster_count,
+        .fat_cluster_count     = driver_state.fat_cluster_count,
+        .fat_extension_cluster = driver_state.fat_extension_cluster,
+        .index_root_cluster    = driver_state.index_root_cluster,
+        .refcount_cluster      = driver_state.refcount_cluster,
+        .journal_cluster       = driver_state.journal_cluster,
+        .zero_policy           = driver_state.zero_policy,
+        .tail_cluster          = driver_state.tail_cluster,
+        .cluster_block_count   = driver_state.cluster_block_count,
+        .struct_signature      = FSINFO_STRUCT_SIGNATURE,
+        .free_cluster_count    = driver_state.free_cluster_count,
+        .next_free_cluster     = driver_state.next_free_cluster,
+        .trail_signature       = FSINFO_TRAIL_SIGNATURE,
+    };
+    cache_write_blocks(&fsinfo, FSINFO_SECTOR, 1);
+}
+
+static void migrate_legacy_index(void);
+
+/**
+ * Allocate contiguous metadata journal & attach it to buffer cache.
+ * Small volume (less than 8 times journal size) stay without journal and write metadata through sync
+ */
+static void init_journal(void) {
+    uint32_t journal_cluster_count = (JOURNAL_BLOCK_COUNT + CLUSTER_BLOCK_COUNT - 1) / CLUSTER_BLOCK_COUNT;
+    if (driver_state.free_cluster_count < 8*journal_cluster_count)
+        return;
+    uint32_t run_length;
+    uint32_t run_start = get_empty_cluster_run(journal_cluster_count, &run_length);
+    if (run_length < journal_cluster_count)
+        return;
+    for (uint32_t i = 0; i < journal_cluster_count; i++)
+        mark_cluster_used(run_start + i, i + 1 < journal_cluster_count ? run_start + i + 1 : FAT32_FAT_END_OF_FILE);
+    driver_state.journal_cluster = run_start;
+    write_fsinfo();
+    cache_sync();
+    cache_journal_attach(cluster_to_lba(driver_state.journal_cluster));
 }
 
 /**
  * Initialize file system driver state, if is_empty_storage() then create_fat32()
- * Else, read and cache entire FileAllocationTable (located at cluster number 1) into driver state
+ * Else, replay metadata journal, load volume geometry from FSInfo and build free cluster bitmap from FAT
  */
 void initialize_filesystem_fat32(void){
     if (is_empty_storage()){
         create_fat32();
+        build_free_cluster_bitmap();
         initialize_root();
         init_index_file();
+        write_fsinfo();
+        cache_sync();
+        init_journal();
     } else {
-        read_clusters(driver_state.fat_table.cluster_map, FAT_CLUSTER_NUMBER, 1);
+        read_volume_geometry();
+        if (driver_state.journal_cluster != 0) {
+            // Replay may rewrite FSInfo, geometry is loaded again afterward
+            cache_journal_attach(cluster_to_lba(driver_state.journal_cluster));
+            read_volume_geometry();
+        }
+        build_free_cluster_bitmap();
+        if (driver_state.index_root_cluster == 0) {
+            migrate_legacy_index();
+            cache_sync();
+        }
+        if (driver_state.journal_cluster == 0)
+            init_journal();
     }
 }
 
 /**
- * Write cluster operation, wrapper for write_blocks().
+ * Write cluster operation, wrapper for cache_write_blocks().
  * Recommended to use struct ClusterBuffer
  * 
  * @param ptr            Pointer to source data
@@ -96,11 +302,11 @@ void initialize_filesystem_fat32(void){
  * @param cluster_count  Cluster count to write, due limitation of write_blocks block_count 255 => max cluster_count = 63
  */
 void write_clusters(const void *ptr, uint32_t cluster_number, uint8_t cluster_count){
-    write_blocks(ptr, cluster_to_lba(cluster_number), cluster_count*CLUSTER_BLOCK_COUNT);
+    cache_write_blocks(ptr, cluster_to_lba(cluster_number), cluster_count*CLUSTER_BLOCK_COUNT);
 }
 
 /**
- * Read cluster operation, wrapper for read_blocks().
+ * Read cluster operation, wrapper for cache_read_blocks().
  * Recommended to use struct ClusterBuffer
  * 
  * @param ptr            Pointer to buffer for reading
@@ -108,454 +314,2086 @@ void write_clusters(const void *ptr, uint32_t cluster_number, uint8_t cluster_co
  * @param cluster_count  Cluster count to read, due limitation of read_blocks block_count 255 => max cluster_count = 63
  */
 void read_clusters(void *ptr, uint32_t cluster_number, uint8_t cluster_count){
-    read_blocks(ptr, cluster_to_lba(cluster_number), cluster_count*CLUSTER_BLOCK_COUNT);
+    cache_read_blocks(ptr, cluster_to_lba(cluster_number), cluster_count*CLUSTER_BLOCK_COUNT);
+}
+
+
+/* -- Directory hash index -- */
+static struct DirectoryIndex dir_index_cache[DIR_INDEX_CACHE_COUNT];
+static uint32_t dir_index_tick;
+
+// FNV-1a hash over 8.3 name
+static uint32_t dir_name_hash(const char *name, const char *ext) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 8; i++)
+        hash = (hash ^ (uint8_t) name[i]) * 16777619u;
+    for (int i = 0; i < 3; i++)
+        hash = (hash ^ (uint8_t) ext[i]) * 16777619u;
+    return hash;
 }
 
+// Check first entry of cluster, only directory cluster may be indexed
+static bool is_directory_cluster(uint32_t cluster) {
+    if (cluster >= driver_state.cluster_count)
+        return FALSE;
+    struct FAT32DirectoryEntry *self = (struct FAT32DirectoryEntry*) cache_get_block(cluster_to_lba(cluster), FALSE);
+    return self->attribute == ATTR_SUBDIRECTORY;
+}
 
 /**
- *  FAT32 Folder / Directory read
+ * Get pointer to directory entry inside buffer cache, only valid until next cache operation
  *
- * @param request buf point to struct FAT32DirectoryTable,
- *                name is directory name,
- *                ext is unused,
- *                parent_cluster_number is target directory table to read,
- *                buffer_size must be exactly sizeof(struct FAT32DirectoryTable)
- * @return Error code: 0 success - 1 not a folder - 2 not found - -1 unknown
+ * @param index       Index of directory containing entry
+ * @param entry       Entry number along directory chain
+ * @param will_modify Mark containing block dirty
  */
-int8_t read_directory(struct FAT32DriverRequest request) {
-    /* load parent to buffer */
-    read_clusters((void*) &driver_state.dir_table_buf, request.parent_cluster_number, 1);
+static struct FAT32DirectoryEntry* dir_entry_ptr(struct DirectoryIndex *index, int16_t entry, bool will_modify) {
+    uint32_t slot      = entry % DIR_ENTRY_PER_CLUSTER;
+    uint32_t lba       = cluster_to_lba(index->cluster[entry / DIR_ENTRY_PER_CLUSTER]) + slot / DIR_ENTRY_PER_BLOCK;
+    uint8_t  *block    = cache_get_block(lba, will_modify);
+    return (struct FAT32DirectoryEntry*) (block + (slot % DIR_ENTRY_PER_BLOCK)*sizeof(struct FAT32DirectoryEntry));
+}
 
-    /* check if parent is dir*/
-    bool parent_is_not_dir = driver_state.dir_table_buf.table[0].attribute != ATTR_SUBDIRECTORY;
-    if (parent_is_not_dir) {
-        return RD_REQUEST_UNKNOWN_RETURN;
-    }
+static void dir_index_link(struct DirectoryIndex *index, int16_t entry, uint32_t hash) {
+    uint32_t b          = hash % DIR_INDEX_BUCKET_COUNT;
+    index->tag[entry]   = hash;
+    index->next[entry]  = index->bucket[b];
+    index->bucket[b]    = entry;
+}
 
-    int dir_length = sizeof(struct FAT32DirectoryTable)/sizeof(struct FAT32DirectoryEntry);
-    for (int i = 1; i < dir_length; i++) {
-        struct FAT32DirectoryEntry current_entry = driver_state.dir_table_buf.table[i];
-        bool current_entry_name_equal = memcmp(current_entry.name, request.name, 8) == 0;
-        bool current_entry_ext_equal = memcmp(current_entry.ext, request.ext, 3) == 0;
-        if (current_entry_ext_equal && current_entry_name_equal) {
-            bool current_entry_is_dir = current_entry.attribute == ATTR_SUBDIRECTORY;
-            if (current_entry_is_dir) {
-                uint32_t request_cluster_number = current_entry.cluster_high << 16 
-                                                    | current_entry.cluster_low;
-                read_clusters(request.buf, request_cluster_number, 1);
-                return RD_REQUEST_SUCCESS_RETURN;
-            } else {
-                return RD_REQUEST_NOT_A_FOLDER_RETURN;
-            }
-        }
+// Push entry number [first, last] into free list, lowest entry end up at free_head
+static void dir_index_free_range(struct DirectoryIndex *index, int16_t first, int16_t last) {
+    for (int16_t e = last; e >= first; e--) {
+        index->next[e]   = index->free_head;
+        index->free_head = e;
     }
-    return RD_REQUEST_NOT_FOUND_RETURN;
 }
 
 /**
- * FAT32 read, read a file from file system.
+ * Get hash index of directory, build index by walking directory cluster chain when
+ * directory is not indexed yet. Least recently used index is replaced.
+ * Caller must ensure dir_cluster is directory, see is_directory_cluster()
  *
- * @param request All attribute will be used for read, buffer_size will limit reading count
- * @return Error code: 0 success - 1 not a file - 2 not enough buffer - 3 not found - -1 unknown
+ * @param dir_cluster First cluster of directory
+ * @return            Index of directory
  */
-int8_t read(struct FAT32DriverRequest request) {
-    /* load parent to buffer*/
-    read_clusters((void*) &driver_state.dir_table_buf, request.parent_cluster_number, 1);
+static struct DirectoryIndex* dir_index_get(uint32_t dir_cluster) {
+    struct DirectoryIndex *victim = &dir_index_cache[0];
+    for (int i = 0; i < DIR_INDEX_CACHE_COUNT; i++) {
+        if (dir_index_cache[i].dir_cluster == dir_cluster) {
+            dir_index_cache[i].last_used = ++dir_index_tick;
+            return &dir_index_cache[i];
+        }
+        if (dir_index_cache[i].last_used < victim->last_used)
+            victim = &dir_index_cache[i];
+    }
 
-    /* check if parent directory */
-    bool parent_is_not_dir = driver_state.dir_table_buf.table[0].attribute != ATTR_SUBDIRECTORY;
-    if (parent_is_not_dir) {
-        return R_REQUEST_UNKNOWN_RETURN;
+    victim->dir_cluster = dir_cluster;
+    victim->last_used   = ++dir_index_tick;
+    victim->free_head   = DIR_INDEX_NONE;
+    for (int b = 0; b < DIR_INDEX_BUCKET_COUNT; b++)
+        victim->bucket[b] = DIR_INDEX_NONE;
+
+    uint32_t cluster_count = 0;
+    for (uint32_t c = dir_cluster; c != FAT32_FAT_END_OF_FILE && cluster_count < DIR_CLUSTER_LIMIT; c = get_fat_entry(c))
+        victim->cluster[cluster_count++] = c;
+    victim->entry_count = cluster_count*DIR_ENTRY_PER_CLUSTER;
+
+    for (int16_t e = victim->entry_count - 1; e >= 1; e--) {
+        struct FAT32DirectoryEntry *entry = dir_entry_ptr(victim, e, FALSE);
+        if (entry->undelete) {
+            dir_index_link(victim, e, dir_name_hash(entry->name, entry->ext));
+        } else {
+            dir_index_free_range(victim, e, e);
+        }
     }
+    return victim;
+}
 
-    int dir_length = sizeof(struct FAT32DirectoryTable)/sizeof(struct FAT32DirectoryEntry);
-    for (int i = 1; i < dir_length; i++) {
-        struct FAT32DirectoryEntry current_entry = driver_state.dir_table_buf.table[i];
-        bool current_entry_name_equal = memcmp(current_entry.name, request.name, 8) == 0;
-        bool current_entry_ext_equal = memcmp(current_entry.ext, request.ext, 3) == 0;
-        if (current_entry_ext_equal && current_entry_name_equal) {
-            bool current_entry_is_file = current_entry.attribute != ATTR_SUBDIRECTORY;
-            if (current_entry_is_file) {
-                uint32_t request_cluster_number = current_entry.cluster_high << 16 
-                                                    | current_entry.cluster_low;
-                int buffer_size = request.buffer_size;
-                int fragment = 0;
-                
-                while (request_cluster_number != FAT32_FAT_END_OF_FILE) {
-                    buffer_size -= CLUSTER_SIZE;
-                    if (buffer_size < 0) {
-                        return R_NOT_ENOUGH_BUFFER_RETURN;
-                    }
-                    int offset = CLUSTER_SIZE*fragment;
-                    read_clusters(request.buf + offset, request_cluster_number, 1);
-                    request_cluster_number = driver_state.fat_table.cluster_map[request_cluster_number];
-                    fragment ++;
-                }
-                if (buffer_size != 0) {
-                    memset(request.buf + CLUSTER_SIZE*fragment, EOF, 1);
-                }
-                return R_REQUEST_SUCCESS_RETURN;
-            } else {
-                return R_REQUEST_NOT_A_FILE_RETURN;
-            }
+// Drop index of directory, used when directory cluster is freed
+static void dir_index_invalidate(uint32_t dir_cluster) {
+    for (int i = 0; i < DIR_INDEX_CACHE_COUNT; i++) {
+        if (dir_index_cache[i].dir_cluster == dir_cluster) {
+            dir_index_cache[i].dir_cluster = 0;
+            dir_index_cache[i].last_used   = 0;
         }
     }
-      
+}
 
-    return R_REQUEST_NOT_FOUND_RETURN;
+// TRUE if indexed directory has no entry other than itself, every used entry is linked in some bucket
+static bool dir_index_is_empty(struct DirectoryIndex *index) {
+    for (int i = 0; i < DIR_INDEX_BUCKET_COUNT; i++) {
+        if (index->bucket[i] != DIR_INDEX_NONE)
+            return FALSE;
+    }
+    return TRUE;
 }
 
-uint32_t get_empty_cluster() {
-    for (uint32_t i = 8; i < CLUSTER_MAP_SIZE; i++) {
-        bool is_current_cluster_empty = (driver_state.fat_table.cluster_map[i] == FAT32_FAT_EMPTY_ENTRY);
-        if (is_current_cluster_empty) {
-            driver_state.fat_table.cluster_map[i] = FAT32_FAT_END_OF_FILE;
-            return i;
-        }
+/**
+ * Find entry with name & ext in indexed directory
+ *
+ * @return Entry number along directory chain, DIR_INDEX_NONE if not found
+ */
+static int16_t dir_index_lookup(struct DirectoryIndex *index, const char *name, const char *ext) {
+    uint32_t hash = dir_name_hash(name, ext);
+    for (int16_t e = index->bucket[hash % DIR_INDEX_BUCKET_COUNT]; e != DIR_INDEX_NONE; e = index->next[e]) {
+        if (index->tag[e] != hash)
+            continue;
+        struct FAT32DirectoryEntry *entry = dir_entry_ptr(index, e, FALSE);
+        if (memcmp(entry->name, name, 8) == 0 && memcmp(entry->ext, ext, 3) == 0)
+            return e;
     }
-    return -1;
+    return DIR_INDEX_NONE;
 }
 
+/**
+ * Append empty cluster into directory chain when directory has no free entry left
+ *
+ * @return FALSE if directory already DIR_CLUSTER_LIMIT long or storage is full
+ */
+static bool dir_index_grow(struct DirectoryIndex *index) {
+    uint32_t cluster_count = index->entry_count / DIR_ENTRY_PER_CLUSTER;
+    if (cluster_count >= DIR_CLUSTER_LIMIT || driver_state.free_cluster_count == 0)
+        return FALSE;
 
-int8_t write(struct FAT32DriverRequest request) {
-    /*load request parent to table buffer, load fat table */
-    read_clusters((void*) &driver_state.dir_table_buf, request.parent_cluster_number, 1);
-    read_clusters((void*) &driver_state.fat_table, FAT_CLUSTER_NUMBER, 1);
+    uint32_t new_cluster = get_empty_cluster();
+    write_clusters(zero_cluster.buf, new_cluster, 1);
+    set_fat_entry(index->cluster[cluster_count - 1], new_cluster);
 
-    /* check if parent is directory */
-    bool parent_is_not_dir = driver_state.dir_table_buf.table[0].attribute != ATTR_SUBDIRECTORY;
-    if (parent_is_not_dir) {
-        return W_REQUEST_INVALID_PARENT_RETURN;
-    }
+    index->cluster[cluster_count] = new_cluster;
+    dir_index_free_range(index, index->entry_count, index->entry_count + DIR_ENTRY_PER_CLUSTER - 1);
+    index->entry_count += DIR_ENTRY_PER_CLUSTER;
+    return TRUE;
+}
 
-    /* check if file with same name already exist*/
-    int dir_length = sizeof(struct FAT32DirectoryTable)/sizeof(struct FAT32DirectoryEntry);
-    for (int i = 1; i < dir_length; i++) {
-        struct FAT32DirectoryEntry current_entry = driver_state.dir_table_buf.table[i];
-        bool current_entry_valid = current_entry.undelete;
-        bool current_entry_name_equal = memcmp(current_entry.name, request.name, 8) == 0;
-        bool current_entry_ext_equal = memcmp(current_entry.ext, request.ext, 3) == 0;
-        if (current_entry_ext_equal && current_entry_name_equal && current_entry_valid) {
-            return W_REQUEST_FILE_ALREADY_EXIST_RETURN;
-        }
-    }
+// Take free entry for name & ext, DIR_INDEX_NONE if directory is full
+static int16_t dir_index_insert(struct DirectoryIndex *index, const char *name, const char *ext) {
+    int16_t entry = index->free_head;
+    if (entry == DIR_INDEX_NONE)
+        return DIR_INDEX_NONE;
+    index->free_head = index->next[entry];
+    dir_index_link(index, entry, dir_name_hash(name, ext));
+    return entry;
+}
 
-    /* check if number of cluster avail in storage suffice */
-    uint32_t num_cluster_needed = ((request.buffer_size)% CLUSTER_SIZE) == 0 ? ((request.buffer_size)/ CLUSTER_SIZE): ((request.buffer_size)/ CLUSTER_SIZE) +1; 
-    uint32_t num_cluster_avail = 0;
-    for (int i = 2; i < CLUSTER_MAP_SIZE && num_cluster_avail < num_cluster_needed; i++) {
-        if (driver_state.fat_table.cluster_map[i] == FAT32_FAT_EMPTY_ENTRY) {
-            num_cluster_avail++;
-        }
+// Unlink used entry from its bucket and return it into free list
+static void dir_index_remove(struct DirectoryIndex *index, int16_t entry) {
+    uint32_t b = index->tag[entry] % DIR_INDEX_BUCKET_COUNT;
+    if (index->bucket[b] == entry) {
+        index->bucket[b] = index->next[entry];
+    } else {
+        int16_t prev = index->bucket[b];
+        while (index->next[prev] != entry)
+            prev = index->next[prev];
+        index->next[prev] = index->next[entry];
     }
-    if (num_cluster_avail < num_cluster_needed) {
-        return W_REQUEST_UNKNOWN_RETURN;
+    dir_index_free_range(index, entry, entry);
+}
+
+/* -- Dentry cache -- */
+static struct DentryCacheEntry dentry_cache[DENTRY_CACHE_SIZE];
+
+static struct DentryCacheEntry* dentry_slot(uint32_t parent_cluster, const char *name, const char *ext) {
+    uint32_t hash = dir_name_hash(name, ext) ^ (parent_cluster * 2654435761u);
+    return &dentry_cache[hash % DENTRY_CACHE_SIZE];
+}
+
+// Remember lookup result, replacing whatever occupy the slot
+static void dentry_store(uint32_t parent_cluster, const char *name, const char *ext,
+        bool negative, uint8_t attribute, uint32_t cluster) {
+    struct DentryCacheEntry *slot = dentry_slot(parent_cluster, name, ext);
+    slot->parent_cluster_number = parent_cluster;
+    memcpy(slot->name, name, 8);
+    memcpy(slot->ext, ext, 3);
+    slot->negative  = negative;
+    slot->attribute = attribute;
+    slot->cluster   = cluster;
+}
+
+// Drop every cached lookup inside directory, used when directory cluster is freed
+static void dentry_purge_directory(uint32_t dir_cluster) {
+    for (int i = 0; i < DENTRY_CACHE_SIZE; i++) {
+        if (dentry_cache[i].parent_cluster_number == dir_cluster)
+            dentry_cache[i].parent_cluster_number = 0;
     }
+}
 
-    /* check for entry avail in parent*/
-    int entry_num = -1;
-    for (int i = 1; i < dir_length && entry_num == -1; i++) {
-        if (driver_state.dir_table_buf.table[i].undelete == 0) {
-            entry_num = i;
+/**
+ * Find child of directory, answered from dentry cache if possible, else from directory hash index
+ *
+ * @param parent_cluster Directory to search, caller must ensure it is directory
+ * @param cluster        Output, first cluster of found entry
+ * @param attribute      Output, attribute of found entry
+ * @return               TRUE if found
+ */
+static bool lookup_child(uint32_t parent_cluster, const char *name, const char *ext,
+        uint32_t *cluster, uint8_t *attribute) {
+    struct DentryCacheEntry *slot = dentry_slot(parent_cluster, name, ext);
+    if (slot->parent_cluster_number != parent_cluster
+            || memcmp(slot->name, name, 8) != 0 || memcmp(slot->ext, ext, 3) != 0) {
+        struct DirectoryIndex *index = dir_index_get(parent_cluster);
+        int16_t entry_num = dir_index_lookup(index, name, ext);
+        if (entry_num == DIR_INDEX_NONE) {
+            dentry_store(parent_cluster, name, ext, TRUE, 0, 0);
+        } else {
+            struct FAT32DirectoryEntry *entry = dir_entry_ptr(index, entry_num, FALSE);
+            dentry_store(parent_cluster, name, ext, FALSE, entry->attribute,
+                            ((uint32_t) entry->cluster_high) << 16 | entry->cluster_low);
         }
     }
-    if (entry_num == -1) {
-        return W_REQUEST_UNKNOWN_RETURN;
-    }
+    if (slot->negative)
+        return FALSE;
+    *cluster   = slot->cluster;
+    *attribute = slot->attribute;
+    return TRUE;
+}
 
-    uint32_t cluster_num_to_write =  get_empty_cluster();
-    struct FAT32DirectoryEntry request_entry = {0};
-    request_entry.user_attribute = 0;
-    request_entry.cluster_high = (uint16_t) (cluster_num_to_write  >> 16);
-    request_entry.cluster_low = (uint16_t) cluster_num_to_write;
-    memcpy(request_entry.ext, request.ext, 3);
-    memcpy(request_entry.name, request.name, 8);
-    request_entry.undelete = 1;
-    driver_state.dir_table_buf.table[0].user_attribute = UATTR_NOT_EMPTY;
 
+/* -- Directory path cache -- */
+static struct DirPathCacheEntry dir_path_cache[DIR_PATH_CACHE_COUNT];
+static uint32_t dir_path_tick;
 
-    if (request.buffer_size == 0) { 
-        /* create new directory */
-        request_entry.attribute = ATTR_SUBDIRECTORY;
-        driver_state.dir_table_buf.table[entry_num]  = request_entry;
+// Forget every cached path, used when directory is deleted or renamed
+static void dir_path_cache_flush(void) {
+    for (int i = 0; i < DIR_PATH_CACHE_COUNT; i++)
+        dir_path_cache[i].cluster = 0;
+}
 
-        struct FAT32DirectoryTable request_directory_table = {0};
-        init_directory_table(&request_directory_table, request.name, 
-                                request.parent_cluster_number);
+/**
+ * Build full path of directory into buffer and cache it
+ *
+ * @param buffer    Output, DIR_PATH_MAX_LENGTH byte
+ * @param cluster   Directory cluster
+ * @param depth     Recursion depth, guard against corrupted parent link
+ * @return          Path length
+ */
+static uint32_t dir_path_build(char *buffer, uint32_t cluster, uint32_t depth) {
+    struct DirPathCacheEntry *victim = &dir_path_cache[0];
+    for (int i = 0; i < DIR_PATH_CACHE_COUNT; i++) {
+        if (dir_path_cache[i].cluster == cluster) {
+            dir_path_cache[i].last_used = ++dir_path_tick;
+            memcpy(buffer, dir_path_cache[i].path, dir_path_cache[i].length + 1);
+            return dir_path_cache[i].length;
+        }
+    }
 
-        write_clusters(&request_directory_table, cluster_num_to_write, 1);
-        write_clusters(&driver_state.dir_table_buf, request.parent_cluster_number, 1);
-        write_clusters(&driver_state.fat_table, FAT_CLUSTER_NUMBER, 1);
-    } else {
-        /* write file */
-        request_entry.attribute = !ATTR_SUBDIRECTORY;
-        driver_state.dir_table_buf.table[entry_num]  = request_entry;     
-        
-        write_clusters(request.buf, cluster_num_to_write, 1);
-        for (uint32_t j = 1; j < num_cluster_needed; j++) {
-            uint32_t next_cluster_num_to_write = get_empty_cluster();
-            driver_state.fat_table.cluster_map[cluster_num_to_write] = next_cluster_num_to_write;
-            int offset = CLUSTER_SIZE*(j);
-            write_clusters((char*) request.buf + offset, next_cluster_num_to_write, 1);
-            cluster_num_to_write = next_cluster_num_to_write;
+    uint32_t length = 0;
+    if (cluster == ROOT_CLUSTER_NUMBER) {
+        memcpy(buffer, "root", 5);
+        length = 4;
+    } else if (is_directory_cluster(cluster) && depth < DIR_PATH_MAX_LENGTH / 2) {
+        struct FAT32DirectoryEntry self = *(struct FAT32DirectoryEntry*) cache_get_block(cluster_to_lba(cluster), FALSE);
+        length = dir_path_build(buffer, ((uint32_t) self.cluster_high) << 16 | self.cluster_low, depth + 1);
+        if (length + 1 + 8 < DIR_PATH_MAX_LENGTH) {
+            buffer[length++] = '/';
+            for (int i = 0; i < 8 && self.name[i] != '\0'; i++)
+                buffer[length++] = self.name[i];
         }
-        write_clusters(&driver_state.dir_table_buf, request.parent_cluster_number, 1);
-        write_clusters(&driver_state.fat_table, FAT_CLUSTER_NUMBER, 1);
+        buffer[length] = '\0';
+    } else {
+        buffer[0] = '\0';
+        return 0;
+    }
 
+    for (int i = 0; i < DIR_PATH_CACHE_COUNT; i++) {
+        if (dir_path_cache[i].last_used < victim->last_used)
+            victim = &dir_path_cache[i];
     }
-    insert_index(request.name, request.ext, request.parent_cluster_number);
-    return W_REQUEST_SUCCESS_RETURN;
+    victim->cluster   = cluster;
+    victim->last_used = ++dir_path_tick;
+    victim->length    = length;
+    memcpy(victim->path, buffer, length + 1);
+    return length;
 }
 
-
 /**
- * FAT32 delete, delete a file or empty directory (only 1 DirectoryEntry) in file system.
+ *  FAT32 Folder / Directory read
  *
- * @param request buf and buffer_size is unused
- * @return Error code: 0 success - 1 not found - 2 folder is not empty - -1 unknown
+ * @param request buf point to struct FAT32DirectoryTable,
+ *                name is directory name,
+ *                ext is unused,
+ *                parent_cluster_number is target directory table to read,
+ *                buffer_size limit copied byte, at most first CLUSTER_SIZE byte of directory table
+ * @return Error code: 0 success - 1 not a folder - 2 not found - -1 unknown
  */
-int8_t delete(struct FAT32DriverRequest request) {
-    read_clusters((void*) &driver_state.dir_table_buf, request.parent_cluster_number, 1);
-    read_clusters((void*) &driver_state.fat_table, FAT_CLUSTER_NUMBER, 1);
+static uint32_t transfer_partial_cluster(uint32_t cluster, uint32_t offset, uint8_t *buf, uint32_t length, bool is_write);
 
-    bool parent_is_not_dir = driver_state.dir_table_buf.table[0].attribute != ATTR_SUBDIRECTORY;
+int8_t read_directory(struct FAT32DriverRequest request) {
+    /* check if parent is dir*/
+    bool parent_is_not_dir = !is_directory_cluster(request.parent_cluster_number);
     if (parent_is_not_dir) {
-        return D_REQUEST_UNKNOWN_RETURN;
+        return RD_REQUEST_UNKNOWN_RETURN;
     }
 
-    int dir_length = sizeof(struct FAT32DirectoryTable) / sizeof(struct FAT32DirectoryEntry);
-    for (int i = 1; i < dir_length; i++) {
-        struct FAT32DirectoryEntry current = driver_state.dir_table_buf.table[i];
-        if (memcmp(current.name, request.name, 8) == 0 && memcmp(current.ext, request.ext, 3) == 0) {
-            if (current.attribute == ATTR_SUBDIRECTORY) {
-                if (current.user_attribute == UATTR_NOT_EMPTY){
-                    return D_FOLDER_NOT_EMPTY_RETURN;
-                } else {
-                    // HAPUS FOLDER
-                    delete_index(request.name, request.ext, request.parent_cluster_number);
-                    uint32_t deleted_cluster_number = ((uint32_t) current.cluster_high) << 16 | current.cluster_low;
-                    driver_state.fat_table.cluster_map[deleted_cluster_number] = FAT32_FAT_EMPTY_ENTRY;
-                    reset_entry(&driver_state.dir_table_buf.table[i]);
-                    struct FAT32DirectoryTable empty = {0};
-                    write_clusters(&empty, deleted_cluster_number, 1);
-                    write_clusters(&driver_state.dir_table_buf.table, request.parent_cluster_number, 1);
-                    write_clusters(&driver_state.fat_table, FAT_CLUSTER_NUMBER, 1);
-                    return D_REQUEST_SUCCESS_RETURN;
-                }
-            } else {
-                // HAPUS FILE
-                // PERLU DIBENERIN
-                delete_index(request.name, request.ext, request.parent_cluster_number);
-                uint32_t deleted_cluster_number = ((uint32_t) current.cluster_high) << 16 | current.cluster_low;
-                while (driver_state.fat_table.cluster_map[deleted_cluster_number] != FAT32_FAT_END_OF_FILE) {
-                    uint32_t temp_cluster = deleted_cluster_number;
-                    reset_entry(&driver_state.dir_table_buf.table[i]);
-                    struct FAT32DirectoryTable empty = {0};
-                    write_clusters(&empty, deleted_cluster_number, 1);
-                    deleted_cluster_number = driver_state.fat_table.cluster_map[temp_cluster];
-                    driver_state.fat_table.cluster_map[temp_cluster] = FAT32_FAT_EMPTY_ENTRY;
-
-                }
-                if (driver_state.fat_table.cluster_map[deleted_cluster_number] == FAT32_FAT_END_OF_FILE) {
-                    driver_state.fat_table.cluster_map[deleted_cluster_number] = FAT32_FAT_EMPTY_ENTRY;
-                    reset_entry(&driver_state.dir_table_buf.table[i]);
-                    struct FAT32DirectoryTable empty = {0};
-                    write_clusters(&empty, deleted_cluster_number, 1);
-                    driver_state.fat_table.cluster_map[deleted_cluster_number] = FAT32_FAT_EMPTY_ENTRY;
-                }
-                write_clusters(&driver_state.dir_table_buf.table, request.parent_cluster_number, 1);
-                write_clusters(&driver_state.fat_table, FAT_CLUSTER_NUMBER, 1);
-                return D_REQUEST_SUCCESS_RETURN;
-            }
-        }
+    uint32_t request_cluster_number;
+    uint8_t  attribute;
+    if (!lookup_child(request.parent_cluster_number, request.name, request.ext, &request_cluster_number, &attribute)) {
+        return RD_REQUEST_NOT_FOUND_RETURN;
     }
 
-    return D_REQUEST_NOT_FOUND_RETURN;
-}
-
-void initialize_root(void){
-    struct FAT32DirectoryTable root = {0};
-    init_directory_table(&root, "root\0\0\0\0", ROOT_CLUSTER_NUMBER);
-    // root.table[0].attribute = ATTR_SUBDIRECTORY;
-    memcpy(root.table[0].ext, "dir", 3);
-
-    // save to memory?
-    write_clusters(&root, ROOT_CLUSTER_NUMBER, 1);
-}   
-
-void reset_entry(struct FAT32DirectoryEntry *entry){
-    memcpy(entry->name, "\0\0\0\0\0\0\0\0", 8);
-    memcpy(entry->ext, "\0\0\0", 3);
-    entry->attribute = 0;
-    entry->undelete = 0;
-    entry->filesize = 0;
-    entry->cluster_high = 0;
-    entry->cluster_low = 0;
+    bool current_entry_is_dir = attribute == ATTR_SUBDIRECTORY;
+    if (current_entry_is_dir) {
+        transfer_partial_cluster(request_cluster_number, 0, request.buf, request.buffer_size, FALSE);
+        return RD_REQUEST_SUCCESS_RETURN;
+    } else {
+        return RD_REQUEST_NOT_A_FOLDER_RETURN;
+    }
 }
 
-void get_dir_path(char* buffer, uint32_t directory_cluster_number) {
-    char path[256] = {0};
-    int depth = 0;
-    int k = 5;
-    memcpy(buffer, "root/", 5);
-    struct FAT32DirectoryTable directory;
-    while (directory_cluster_number != ROOT_CLUSTER_NUMBER) {
-        read_clusters(&directory, directory_cluster_number, 1);
-        memmove(path + 8*depth, directory.table->name, 8);
-        depth++;
-        directory_cluster_number = directory.table->cluster_high << 16 
-            | directory.table->cluster_low;
+uint32_t get_empty_cluster() {
+    if (driver_state.free_cluster_count == 0) {
+        return -1;
     }
-    
-    for (int i = depth - 1; i >= 0; i--) {
-        for (int j = 0; j <= 8; j++) {
-            if (path[i*8 + j] == '\0') {
-                continue;
-            }
-            buffer[k] = path[i*8 + j];
-            k++;
-        }
-        if (i != depth - 1) {
-            k--;
+    /* skip fully used 32-cluster word of bitmap at once */
+    for (uint32_t word = driver_state.next_free_cluster / 32; word < (driver_state.cluster_count + 31) / 32; word++) {
+        uint32_t bits = driver_state.free_cluster_bitmap[word];
+        if (bits == 0) {
+            continue;
         }
-        buffer[k] = '/';
-        k++;
+        uint32_t i = word * 32 + __builtin_ctz(bits);
+        mark_cluster_used(i, FAT32_FAT_END_OF_FILE);
+        driver_state.next_free_cluster = i + 1;
+        return i;
     }
-    buffer[--k] = '\0';
+    return -1;
 }
 
-void get_children(char* buffer, uint32_t directory_cluster_number) {
-    struct FAT32DirectoryTable directory;
-    read_clusters(&directory, directory_cluster_number, 1);
-    int dir_length = sizeof(struct FAT32DirectoryTable)/sizeof(struct FAT32DirectoryEntry);
-    int idx = 0;
-    for (int i = 1; i < dir_length; i++) {
-        struct FAT32DirectoryEntry current_child = directory.table[i];
-        bool current_child_name_na = memcmp(current_child.name, "\0\0\0\0\0\0\0\0", 8) == 0;
-        bool current_child_ext_na = memcmp(current_child.ext, "\0\0\0", 3) == 0;
-        if (current_child_name_na && current_child_ext_na) {
+uint32_t get_empty_cluster_run(uint32_t count, uint32_t *run_length) {
+    uint32_t longest_start  = 0;
+    uint32_t longest_length = 0;
+    uint32_t i = driver_state.next_free_cluster;
+    while (i < driver_state.cluster_count) {
+        if (driver_state.free_cluster_bitmap[i / 32] == 0) {
+            i = (i / 32 + 1) * 32;
             continue;
-        } else {
-            for (int j = 0; j <= 8; j++) {
-                if (current_child.name[j] == '\0') {
-                    break;
-                }
-                buffer[idx] = current_child.name[j];
-                idx++;
-            }
-            if (current_child_ext_na) {
-                buffer[idx] = '.';
-                idx++;
-                buffer[idx] = 'f';
-                idx++;
-                buffer[idx] = 'i';
-                idx++;
-                buffer[idx] = 'l';
-                idx++;
-                buffer[idx] = 'e';
-                idx++;
-            } else if (memcmp(current_child.ext, "dir", 3) == 1) {
-                buffer[idx] = '.';
-                idx++;
-                for (int j = 0; j <= 3; j++) {
-                    if (current_child.ext[j] == '\0') {
-                        break;
-                    }
-                    buffer[idx] = current_child.ext[j];
-                    idx++;
-                }
-            }
         }
-        buffer[idx] = '\n';
-        idx++;
+        if (!is_cluster_free(i)) {
+            i++;
+            continue;
+        }
+        uint32_t start = i;
+        while (i < driver_state.cluster_count && i - start < count && is_cluster_free(i)) {
+            i++;
+        }
+        if (i - start == count) {
+            *run_length = count;
+            return start;
+        }
+        if (i - start > longest_length) {
+            longest_start  = start;
+            longest_length = i - start;
+        }
     }
+    *run_length = longest_length;
+    return longest_start;
 }
 
-uint32_t move_to_child_directory(struct FAT32DriverRequest request) {
-    struct FAT32DirectoryTable directory;
-    read_clusters(&directory, request.parent_cluster_number, 1);
-    int dir_length = sizeof(struct FAT32DirectoryTable)/sizeof(struct FAT32DirectoryEntry);
-    for (int i = 1; i < dir_length; i++) {
-        struct FAT32DirectoryEntry current_child = directory.table[i];
-        bool current_entry_name_equal = memcmp(current_child.name, request.name, 8) == 0;
-        bool current_entry_ext_equal = memcmp(current_child.ext, "dir", 3) == 0;
-        if (current_entry_ext_equal && current_entry_name_equal) {
-            return current_child.cluster_high << 16 | current_child.cluster_low;
+/**
+ * Allocate count clusters using contiguous free runs and link them after prev_cluster.
+ * Caller must ensure enough free clusters.
+ *
+ * @param prev_cluster Last cluster of chain to extend, 0 for new chain
+ * @param count        Cluster count
+ * @return             First allocated cluster number
+ */
+static uint32_t allocate_cluster_chain(uint32_t prev_cluster, uint32_t count) {
+    uint32_t first_cluster = 0;
+    uint32_t allocated     = 0;
+    while (allocated < count) {
+        uint32_t run_length;
+        uint32_t run_start = get_empty_cluster_run(count - allocated, &run_length);
+        for (uint32_t k = 0; k < run_length - 1; k++) {
+            mark_cluster_used(run_start + k, run_start + k + 1);
+        }
+        mark_cluster_used(run_start + run_length - 1, FAT32_FAT_END_OF_FILE);
+        if (first_cluster == 0) {
+            first_cluster = run_start;
         }
+        if (prev_cluster != 0) {
+            set_fat_entry(prev_cluster, run_start);
+        }
+        prev_cluster = run_start + run_length - 1;
+        allocated   += run_length;
     }
-    return 0;
+    return first_cluster;
 }
 
-uint32_t move_to_parent_directory(struct FAT32DriverRequest request) {
-    struct FAT32DirectoryTable directory;
-    read_clusters(&directory, request.parent_cluster_number, 1);
-    return directory.table->cluster_high << 16 | directory.table->cluster_low;;
+/**
+ * Walk cluster chain until its last cluster
+ *
+ * @param cluster First cluster of chain
+ * @param length  Output, chain length in cluster
+ * @return        Last cluster of chain
+ */
+static uint32_t cluster_chain_last(uint32_t cluster, uint32_t *length) {
+    *length = 1;
+    for (uint32_t next = get_fat_entry(cluster); next != FAT32_FAT_END_OF_FILE; next = get_fat_entry(cluster)) {
+        cluster = next;
+        (*length)++;
+    }
+    return cluster;
 }
 
-void init_index_file() {
-    read_clusters(&driver_state.fat_table, FAT_CLUSTER_NUMBER, 1);
-    driver_state.fat_table.cluster_map[INDEX_CLUSTER_NUMBER] = 0;
-    for (uint32_t i = 1; i < sizeof(struct IndexTable)/ CLUSTER_SIZE; i++) {
-        driver_state.fat_table.cluster_map[INDEX_CLUSTER_NUMBER + i] = FAT32_FAT_END_OF_FILE;
+/* -- Shared cluster (reflink) -- */
+
+/**
+ * Reference count table hold one byte per cluster: number of file sharing that cluster
+ * besides first owner. Shared cluster always form tail of every chain holding it, as FAT
+ * next pointer of shared cluster is shared too. So chain is exclusive prefix + shared suffix
+ */
+static uint8_t refcount_get(uint32_t cluster) {
+    if (driver_state.refcount_cluster == 0) {
+        return 0;
     }
-    write_clusters(&driver_state.fat_table, FAT_CLUSTER_NUMBER, 1);
+    uint8_t *block = cache_get_block(cluster_to_lba(driver_state.refcount_cluster) + cluster / BLOCK_SIZE, FALSE);
+    return block[cluster % BLOCK_SIZE];
 }
 
-void insert_index(char* name, char* ext, uint32_t parent_cluster_number) {
-    struct IndexTable index_table;
-    read_clusters(&driver_state.fat_table, FAT_CLUSTER_NUMBER, 1);
-    read_clusters(&index_table, INDEX_CLUSTER_NUMBER, sizeof(struct IndexTable)/ CLUSTER_SIZE);
-    int insert_idx = driver_state.fat_table.cluster_map[INDEX_CLUSTER_NUMBER];
-    memcpy(index_table.buf[insert_idx].name, name, 8);
-    memcpy(index_table.buf[insert_idx].ext, ext, 3);
-    index_table.buf[insert_idx].parent_cluster_number = parent_cluster_number;
-    driver_state.fat_table.cluster_map[INDEX_CLUSTER_NUMBER]++;
-    write_clusters(&index_table, INDEX_CLUSTER_NUMBER, sizeof(struct IndexTable)/ CLUSTER_SIZE);
-    write_clusters(&driver_state.fat_table, FAT_CLUSTER_NUMBER, 1);
+static void refcount_set(uint32_t cluster, uint8_t count) {
+    uint8_t *block = cache_get_block(cluster_to_lba(driver_state.refcount_cluster) + cluster / BLOCK_SIZE, TRUE);
+    block[cluster % BLOCK_SIZE] = count;
 }
 
-
-uint32_t search_index(uint32_t* buffer, char* name, char* ext) {
-    struct IndexTable index_table;
-    read_clusters(&driver_state.fat_table, FAT_CLUSTER_NUMBER, 1);
-    read_clusters(&index_table, INDEX_CLUSTER_NUMBER, sizeof(struct IndexTable)/ CLUSTER_SIZE);
-    int entry_count = driver_state.fat_table.cluster_map[INDEX_CLUSTER_NUMBER];
-    uint32_t found_count = 0;
-    for (int i = 0; i < entry_count; i++) {
-        struct IndexEntry entry = index_table.buf[i];
-        if (memcmp(entry.name, name, 8) == 0 &&
-                memcmp(entry.ext, ext, 3) == 0) {
-                    memcpy(buffer + found_count, &entry.parent_cluster_number, 4);
-                    found_count++;
+// Allocate zeroed reference count table on first share, FALSE if storage has no contiguous room for it
+static bool refcount_table_init(void) {
+    if (driver_state.refcount_cluster != 0) {
+        return TRUE;
+    }
+    uint32_t table_cluster_count = (driver_state.cluster_count + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    uint32_t run_length;
+    uint32_t run_start = get_empty_cluster_run(table_cluster_count, &run_length);
+    if (run_length < table_cluster_count) {
+        return FALSE;
+    }
+    for (uint32_t i = 0; i < table_cluster_count; i++) {
+        mark_cluster_used(run_start + i, i + 1 < table_cluster_count ? run_start + i + 1 : FAT32_FAT_END_OF_FILE);
+        write_clusters(zero_cluster.buf, run_start + i, 1);
+    }
+    driver_state.refcount_cluster = run_start;
+    return TRUE;
+}
+
+// Add one reference to every cluster of chain, FALSE if table is unavailable or any count is saturated
+static bool share_cluster_chain(uint32_t cluster) {
+    if (!refcount_table_init()) {
+        return FALSE;
+    }
+    for (uint32_t c = cluster; c != FAT32_FAT_END_OF_FILE; c = get_fat_entry(c)) {
+        if (refcount_get(c) == REFCOUNT_MAX)
+            return FALSE;
+    }
+    for (uint32_t c = cluster; c != FAT32_FAT_END_OF_FILE; c = get_fat_entry(c)) {
+        refcount_set(c, refcount_get(c) + 1);
+    }
+    return TRUE;
+}
+
+/**
+ * Drop reference of chain, cluster without other owner is freed. Freed cluster is zeroed now
+ * with ZERO_POLICY_EAGER, or discarded from cache & left for scrub_free_clusters() with ZERO_POLICY_LAZY
+ */
+static void release_cluster_chain(uint32_t cluster) {
+    while (cluster != FAT32_FAT_END_OF_FILE) {
+        uint32_t next_cluster = get_fat_entry(cluster);
+        uint8_t  count        = refcount_get(cluster);
+        if (count > 0) {
+            refcount_set(cluster, count - 1);
+        } else if (driver_state.zero_policy == ZERO_POLICY_LAZY) {
+            cache_discard_blocks(cluster_to_lba(cluster), CLUSTER_BLOCK_COUNT);
+            mark_cluster_free(cluster);
+            if (!is_cluster_scrub_pending(cluster)) {
+                driver_state.scrub_cluster_bitmap[cluster / 32] |= 1u << (cluster % 32);
+                driver_state.scrub_cluster_count++;
+            }
+        } else {
+            write_clusters(zero_cluster.buf, cluster, 1);
+            mark_cluster_free(cluster);
+        }
+        cluster = next_cluster;
+    }
+}
+
+uint32_t scrub_free_clusters(uint32_t max_count) {
+    if (driver_state.scrub_cluster_count == 0)
+        return 0;
+    // Zero is written directly into disk, free must be committed first so replay never resurrect zeroed cluster
+    cache_commit(TRUE);
+    uint32_t scrubbed = 0;
+    for (uint32_t word = 0; word < (driver_state.cluster_count + 31) / 32; word++) {
+        if (driver_state.scrub_cluster_count == 0 || scrubbed == max_count)
+            break;
+        while (driver_state.scrub_cluster_bitmap[word] != 0 && scrubbed < max_count) {
+            uint32_t cluster = word * 32 + __builtin_ctz(driver_state.scrub_cluster_bitmap[word]);
+            cache_zero_blocks(cluster_to_lba(cluster), CLUSTER_BLOCK_COUNT);
+            clear_cluster_scrub(cluster);
+            scrubbed++;
+        }
+    }
+    return scrubbed;
+}
+
+int8_t set_zero_policy(uint32_t policy) {
+    if (policy != ZERO_POLICY_EAGER && policy != ZERO_POLICY_LAZY)
+        return -1;
+    driver_state.zero_policy = policy;
+    if (policy == ZERO_POLICY_EAGER)
+        scrub_free_clusters(driver_state.scrub_cluster_count);
+    write_fsinfo();
+    return 0;
+}
+
+/**
+ * Make first cluster_count clusters of chain exclusive before they are modified.
+ * Every shared cluster in range is duplicated and relinked, path before it is exclusive already
+ *
+ * @param first_cluster In / out, first cluster of chain, changed if first cluster was shared
+ * @param cluster_count Cluster count from chain start, range past chain end cover whole chain
+ * @return Duplicated cluster count, -1 if storage does not have enough free cluster
+ */
+static int32_t unshare_cluster_chain(uint32_t *first_cluster, uint32_t cluster_count) {
+    if (driver_state.refcount_cluster == 0) {
+        return 0;
+    }
+    uint32_t needed  = 0;
+    uint32_t cluster = *first_cluster;
+    for (uint32_t i = 0; i < cluster_count && cluster != FAT32_FAT_END_OF_FILE; i++) {
+        if (refcount_get(cluster) > 0)
+            needed++;
+        cluster = get_fat_entry(cluster);
+    }
+    if (needed > driver_state.free_cluster_count) {
+        return -1;
+    }
+
+    uint32_t prev_cluster = 0;
+    cluster = *first_cluster;
+    for (uint32_t i = 0; i < cluster_count && cluster != FAT32_FAT_END_OF_FILE; i++) {
+        uint32_t next_cluster = get_fat_entry(cluster);
+        uint8_t  count        = refcount_get(cluster);
+        if (count > 0) {
+            uint32_t copy_cluster = get_empty_cluster();
+            read_clusters(driver_state.cluster_buf.buf, cluster, 1);
+            write_clusters(driver_state.cluster_buf.buf, copy_cluster, 1);
+            set_fat_entry(copy_cluster, next_cluster);
+            refcount_set(cluster, count - 1);
+            if (prev_cluster == 0)
+                *first_cluster = copy_cluster;
+            else
+                set_fat_entry(prev_cluster, copy_cluster);
+            cluster = copy_cluster;
+        }
+        prev_cluster = cluster;
+        cluster      = next_cluster;
+    }
+    return needed;
+}
+
+// Allocate new chain of length clusters holding copy of chain data, caller must ensure enough free clusters
+static uint32_t duplicate_cluster_chain(uint32_t cluster, uint32_t length) {
+    uint32_t copy_first = allocate_cluster_chain(0, length);
+    for (uint32_t copy_cluster = copy_first; cluster != FAT32_FAT_END_OF_FILE; ) {
+        read_clusters(driver_state.cluster_buf.buf, cluster, 1);
+        write_clusters(driver_state.cluster_buf.buf, copy_cluster, 1);
+        cluster      = get_fat_entry(cluster);
+        copy_cluster = get_fat_entry(copy_cluster);
+    }
+    return copy_first;
+}
+
+
+/**
+ * Transfer part of single cluster through driver_state.cluster_buf, only blocks covering the range are touched.
+ *
+ * @return Byte count transferred
+ */
+static uint32_t transfer_partial_cluster(uint32_t cluster, uint32_t offset, uint8_t *buf, uint32_t length, bool is_write) {
+    uint32_t part = CLUSTER_SIZE - offset < length ? CLUSTER_SIZE - offset : length;
+    if (part == 0) {
+        return 0;
+    }
+    uint32_t first_block  = offset / BLOCK_SIZE;
+    uint32_t block_count  = (offset + part - 1) / BLOCK_SIZE - first_block + 1;
+    uint32_t lba          = cluster_to_lba(cluster) + first_block;
+    uint32_t block_offset = offset % BLOCK_SIZE;
+    cache_read_blocks(driver_state.cluster_buf.buf, lba, block_count);
+    if (is_write) {
+        memcpy(driver_state.cluster_buf.buf + block_offset, buf, part);
+        cache_write_blocks(driver_state.cluster_buf.buf, lba, block_count);
+    } else {
+        memcpy(buf, driver_state.cluster_buf.buf + block_offset, part);
+    }
+    return part;
+}
+
+/**
+ * Transfer byte range of physically contiguous cluster run, no FAT access
+ *
+ * @param cluster  First cluster of run
+ * @param offset   Byte offset from start of run
+ * @param buf      Source for write, destination for read
+ * @param length   Byte count, offset + length must be inside run
+ * @param is_write Write buf into run if TRUE, else read run into buf
+ */
+static void transfer_cluster_run(uint32_t cluster, uint32_t offset, uint8_t *buf, uint32_t length, bool is_write) {
+    cluster += offset / CLUSTER_SIZE;
+    offset  %= CLUSTER_SIZE;
+    while (length > 0) {
+        uint32_t part;
+        if (offset != 0 || length < CLUSTER_SIZE) {
+            part    = transfer_partial_cluster(cluster, offset, buf, length, is_write);
+            offset  = 0;
+            cluster++;
+        } else {
+            uint32_t run_length = length / CLUSTER_SIZE;
+            if (run_length > CLUSTER_RUN_MAX_COUNT)
+                run_length = CLUSTER_RUN_MAX_COUNT;
+            if (is_write)
+                write_clusters(buf, cluster, run_length);
+            else
+                read_clusters(buf, cluster, run_length);
+            part     = run_length*CLUSTER_SIZE;
+            cluster += run_length;
+        }
+        buf    += part;
+        length -= part;
+    }
+}
+
+/**
+ * Transfer byte range of cluster chain, chain must be long enough to hold the range.
+ * Partial cluster go through driver_state.cluster_buf (read-modify-write for write),
+ * contiguous whole clusters go with single multi-cluster transfer
+ *
+ * @param cluster  First cluster of chain
+ * @param offset   Byte offset from start of chain
+ * @param buf      Source for write, destination for read
+ * @param length   Byte count
+ * @param is_write Write buf into chain if TRUE, else read chain into buf
+ */
+static void transfer_cluster_range(uint32_t cluster, uint32_t offset, uint8_t *buf, uint32_t length, bool is_write) {
+    for (uint32_t i = 0; i < offset / CLUSTER_SIZE; i++) {
+        cluster = get_fat_entry(cluster);
+    }
+    offset %= CLUSTER_SIZE;
+
+    while (length > 0) {
+        uint32_t last_cluster;
+        if (offset != 0 || length < CLUSTER_SIZE) {
+            uint32_t part = transfer_partial_cluster(cluster, offset, buf, length, is_write);
+            buf         += part;
+            length      -= part;
+            offset       = 0;
+            last_cluster = cluster;
+        } else {
+            /* coalesce contiguous whole clusters into single transfer */
+            uint32_t run_length = 1;
+            while (run_length < CLUSTER_RUN_MAX_COUNT && (run_length + 1)*CLUSTER_SIZE <= length
+                    && get_fat_entry(cluster + run_length - 1) == cluster + run_length) {
+                run_length++;
+            }
+            if (is_write)
+                write_clusters(buf, cluster, run_length);
+            else
+                read_clusters(buf, cluster, run_length);
+            buf         += run_length*CLUSTER_SIZE;
+            length      -= run_length*CLUSTER_SIZE;
+            last_cluster = cluster + run_length - 1;
+        }
+        if (length > 0) {
+            cluster = get_fat_entry(last_cluster);
+        }
+    }
+}
+
+/* -- Tail packing -- */
+
+static bool is_tail_packed(struct FAT32DirectoryEntry entry) {
+    return entry.attribute != ATTR_SUBDIRECTORY && (entry.user_attribute & UATTR_TAIL_PACKED);
+}
+
+// Header of tail cluster, 0 if cluster is not tail cluster
+static struct TailClusterHeader* tail_header(uint32_t cluster, bool will_modify) {
+    if (cluster == 0) {
+        return 0;
+    }
+    struct TailClusterHeader *header = (struct TailClusterHeader*) cache_get_block(cluster_to_lba(cluster), will_modify);
+    return header->magic == TAIL_MAGIC ? header : 0;
+}
+
+static uint32_t tail_unit_mask(uint32_t offset, uint32_t size) {
+    uint32_t unit_count = (size + TAIL_UNIT_SIZE - 1) / TAIL_UNIT_SIZE;
+    return ((1u << unit_count) - 1) << (offset / TAIL_UNIT_SIZE);
+}
+
+// Reserve contiguous unit for size byte inside cluster, FALSE if cluster has no room
+static bool tail_reserve(uint32_t cluster, uint32_t size, uint32_t *offset) {
+    struct TailClusterHeader *header = tail_header(cluster, FALSE);
+    if (header == 0) {
+        return FALSE;
+    }
+    for (uint32_t unit = 1; unit*TAIL_UNIT_SIZE + size <= CLUSTER_SIZE; unit++) {
+        uint32_t mask = tail_unit_mask(unit*TAIL_UNIT_SIZE, size);
+        if ((header->unit_bitmap & mask) == 0) {
+            tail_header(cluster, TRUE)->unit_bitmap |= mask;
+            *offset = unit*TAIL_UNIT_SIZE;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * Find room for small file, current tail cluster first then candidates, new tail cluster is allocated
+ * when none of them has room
+ *
+ * @return Tail cluster, 0 if storage is full
+ */
+static uint32_t tail_allocate(uint32_t size, uint32_t *offset) {
+    if (tail_reserve(driver_state.tail_cluster, size, offset)) {
+        return driver_state.tail_cluster;
+    }
+    for (uint32_t i = 0; i < TAIL_CANDIDATE_COUNT; i++) {
+        if (tail_reserve(driver_state.tail_candidate[i], size, offset)) {
+            return driver_state.tail_candidate[i];
+        }
+        driver_state.tail_candidate[i] = 0;
+    }
+    if (driver_state.free_cluster_count == 0) {
+        return 0;
+    }
+
+    /* old content of reallocated cluster is never read, only header is initialized */
+    uint32_t cluster = get_empty_cluster();
+    struct TailClusterHeader *header = (struct TailClusterHeader*) cache_get_block(cluster_to_lba(cluster), TRUE);
+    header->magic       = TAIL_MAGIC;
+    header->unit_bitmap = 1;
+    driver_state.tail_cluster = cluster;
+    tail_reserve(cluster, size, offset);
+    return cluster;
+}
+
+// Release unit of packed file, tail cluster without any packed file left is freed
+static void tail_release(uint32_t cluster, uint32_t offset, uint32_t size) {
+    struct TailClusterHeader *header = tail_header(cluster, TRUE);
+    if (header == 0) {
+        return;
+    }
+    header->unit_bitmap &= ~tail_unit_mask(offset, size);
+    if (cluster == driver_state.tail_cluster) {
+        return;
+    }
+
+    int32_t slot = -1;
+    for (uint32_t i = 0; i < TAIL_CANDIDATE_COUNT; i++) {
+        if (driver_state.tail_candidate[i] == cluster)
+            slot = i;
+    }
+    if (header->unit_bitmap == 1) {
+        header->magic = 0;
+        release_cluster_chain(cluster);
+        if (slot >= 0)
+            driver_state.tail_candidate[slot] = 0;
+    } else if (slot < 0) {
+        driver_state.tail_candidate[driver_state.tail_candidate_next] = cluster;
+        driver_state.tail_candidate_next = (driver_state.tail_candidate_next + 1) % TAIL_CANDIDATE_COUNT;
+    }
+}
+
+/**
+ * Move tail packed file into its own cluster before it is modified
+ *
+ * @return FALSE if storage does not have free cluster, TRUE if file is (now) not tail packed
+ */
+static bool unpack_file_entry(struct DirectoryIndex *index, int16_t entry_num) {
+    struct FAT32DirectoryEntry entry = *dir_entry_ptr(index, entry_num, FALSE);
+    if (!is_tail_packed(entry)) {
+        return TRUE;
+    }
+    if (driver_state.free_cluster_count == 0) {
+        return FALSE;
+    }
+    uint8_t *data = kmalloc(entry.filesize);
+    if (data == 0) {
+        return FALSE;
+    }
+    uint32_t tail_cluster = ((uint32_t) entry.cluster_high) << 16 | entry.cluster_low;
+    transfer_partial_cluster(tail_cluster, entry.access_date, data, entry.filesize, FALSE);
+    uint32_t cluster = get_empty_cluster();
+    transfer_partial_cluster(cluster, 0, data, entry.filesize, TRUE);
+    tail_release(tail_cluster, entry.access_date, entry.filesize);
+    kfree(data);
+
+    struct FAT32DirectoryEntry *modified = dir_entry_ptr(index, entry_num, TRUE);
+    modified->user_attribute &= ~UATTR_TAIL_PACKED;
+    modified->access_date     = 0;
+    modified->cluster_high    = (uint16_t) (cluster >> 16);
+    modified->cluster_low     = (uint16_t) cluster;
+    return TRUE;
+}
+
+// Read byte range of file entry, range must be inside file
+static void read_file_entry(struct FAT32DirectoryEntry entry, uint32_t offset, uint8_t *buf, uint32_t length) {
+    uint32_t cluster = ((uint32_t) entry.cluster_high) << 16 | entry.cluster_low;
+    if (is_tail_packed(entry))
+        transfer_partial_cluster(cluster, entry.access_date + offset, buf, length, FALSE);
+    else
+        transfer_cluster_range(cluster, offset, buf, length, FALSE);
+}
+
+/**
+ * Allocate cluster chain for size byte and write data into it, rest of last cluster is left as is.
+ * Every contiguous run is written with minimum write_clusters() call. Caller must ensure enough free clusters.
+ *
+ * @param buf  Data to write
+ * @param size Byte count, not 0
+ * @return     First cluster number of the chain
+ */
+static uint32_t write_cluster_chain(const uint8_t *buf, uint32_t size) {
+    uint32_t first_cluster = allocate_cluster_chain(0, (size + CLUSTER_SIZE - 1) / CLUSTER_SIZE);
+    transfer_cluster_range(first_cluster, 0, (uint8_t*) buf, size, TRUE);
+    return first_cluster;
+}
+
+
+int8_t write(struct FAT32DriverRequest request) {
+    /* check if parent is directory */
+    bool parent_is_not_dir = !is_directory_cluster(request.parent_cluster_number);
+    if (parent_is_not_dir) {
+        return W_REQUEST_INVALID_PARENT_RETURN;
+    }
+
+    /* check if file with same name already exist*/
+    struct DirectoryIndex *index = dir_index_get(request.parent_cluster_number);
+    if (dir_index_lookup(index, request.name, request.ext) != DIR_INDEX_NONE) {
+        return W_REQUEST_FILE_ALREADY_EXIST_RETURN;
+    }
+
+    /* check if number of cluster avail in storage suffice */
+    uint32_t num_cluster_needed = ((request.buffer_size)% CLUSTER_SIZE) == 0 ? ((request.buffer_size)/ CLUSTER_SIZE): ((request.buffer_size)/ CLUSTER_SIZE) +1; 
+    if (num_cluster_needed == 0) {
+        /* directory still need 1 cluster for its table */
+        num_cluster_needed = 1;
+    }
+    /* headroom for name index split along whole path is reserved too */
+    bool parent_is_full = index->free_head == DIR_INDEX_NONE;
+    if (driver_state.free_cluster_count < num_cluster_needed + (parent_is_full ? 1 : 0) + INDEX_MAX_HEIGHT) {
+        return W_REQUEST_UNKNOWN_RETURN;
+    }
+
+    /* new directory table only need CLUSTER_SIZE zeroed, not whole struct */
+    struct FAT32DirectoryTable *request_directory_table = 0;
+    if (request.buffer_size == 0 && (request_directory_table = kmalloc(CLUSTER_SIZE)) == 0) {
+        return W_REQUEST_UNKNOWN_RETURN;
+    }
+
+    /* check for entry avail in parent, extend parent chain if every entry is used */
+    if (parent_is_full && !dir_index_grow(index)) {
+        kfree(request_directory_table);
+        return W_REQUEST_UNKNOWN_RETURN;
+    }
+    /* key is indexed before entry is placed, failed write leave index & directory consistent */
+    if (insert_index(request.name, request.ext, request.parent_cluster_number) != 0) {
+        kfree(request_directory_table);
+        return W_REQUEST_UNKNOWN_RETURN;
+    }
+    int16_t entry_num = dir_index_insert(index, request.name, request.ext);
+
+    struct FAT32DirectoryEntry request_entry = {0};
+    request_entry.user_attribute = 0;
+    memcpy(request_entry.ext, request.ext, 3);
+    memcpy(request_entry.name, request.name, 8);
+    request_entry.undelete = 1;
+
+    uint32_t cluster_num_to_write;
+    if (request.buffer_size == 0) { 
+        /* create new directory */
+        memset(request_directory_table, 0, CLUSTER_SIZE);
+        init_directory_table(request_directory_table, request.name, 
+                                request.parent_cluster_number);
+        cluster_num_to_write = write_cluster_chain((uint8_t*) request_directory_table, CLUSTER_SIZE);
+        kfree(request_directory_table);
+        request_entry.attribute = ATTR_SUBDIRECTORY;
+    } else {
+        /* small file is packed into tail cluster, else every contiguous run written with single multi-cluster write */
+        uint32_t tail_offset;
+        if (request.buffer_size <= TAIL_MAX_SIZE 
+                && (cluster_num_to_write = tail_allocate(request.buffer_size, &tail_offset)) != 0) {
+            transfer_partial_cluster(cluster_num_to_write, tail_offset, request.buf, request.buffer_size, TRUE);
+            request_entry.user_attribute = UATTR_FILESIZE_EXACT | UATTR_TAIL_PACKED;
+            request_entry.access_date    = tail_offset;
+        } else {
+            cluster_num_to_write = write_cluster_chain((uint8_t*) request.buf, request.buffer_size);
+            request_entry.user_attribute = UATTR_FILESIZE_EXACT;
+        }
+        request_entry.attribute = !ATTR_SUBDIRECTORY;
+        request_entry.filesize  = request.buffer_size;
+    }
+    request_entry.cluster_high = (uint16_t) (cluster_num_to_write  >> 16);
+    request_entry.cluster_low = (uint16_t) cluster_num_to_write;
+    *dir_entry_ptr(index, entry_num, TRUE) = request_entry;
+    dir_entry_ptr(index, 0, TRUE)->user_attribute = UATTR_NOT_EMPTY;
+    dentry_store(request.parent_cluster_number, request.name, request.ext, FALSE, 
+                    request_entry.attribute, cluster_num_to_write);
+
+    write_fsinfo();
+    return W_REQUEST_SUCCESS_RETURN;
+}
+
+
+/**
+ * Keep open handle of file in sync after file is changed through path request,
+ * handle of deleted file is closed
+ *
+ * @param origin Handle that made the change, skipped
+ */
+static void file_handle_update(uint32_t parent_cluster, int16_t entry_num, bool is_deleted, const struct FileHandle *origin);
+
+/**
+ * FAT32 delete, delete a file or empty directory (only 1 DirectoryEntry) in file system.
+ *
+ * @param request buf and buffer_size is unused
+ * @return Error code: 0 success - 1 not found - 2 folder is not empty - -1 unknown
+ */
+int8_t delete(struct FAT32DriverRequest request) {
+    bool parent_is_not_dir = !is_directory_cluster(request.parent_cluster_number);
+    if (parent_is_not_dir) {
+        return D_REQUEST_UNKNOWN_RETURN;
+    }
+
+    struct DirectoryIndex *index = dir_index_get(request.parent_cluster_number);
+    int16_t i = dir_index_lookup(index, request.name, request.ext);
+    if (i == DIR_INDEX_NONE) {
+        return D_REQUEST_NOT_FOUND_RETURN;
+    }
+
+    struct FAT32DirectoryEntry current = *dir_entry_ptr(index, i, FALSE);
+    uint32_t deleted_cluster_number = ((uint32_t) current.cluster_high) << 16 | current.cluster_low;
+    if (current.attribute == ATTR_SUBDIRECTORY) {
+        /* parent index is fetched again as child index may evict it */
+        bool is_empty = dir_index_is_empty(dir_index_get(deleted_cluster_number));
+        index         = dir_index_get(request.parent_cluster_number);
+        if (!is_empty) {
+            return D_FOLDER_NOT_EMPTY_RETURN;
+        }
+    }
+
+    // HAPUS FILE / FOLDER, folder chain is freed same way as file chain
+    delete_index(request.name, request.ext, request.parent_cluster_number);
+    if (current.attribute == ATTR_SUBDIRECTORY) {
+        dir_index_invalidate(deleted_cluster_number);
+        dentry_purge_directory(deleted_cluster_number);
+        dir_path_cache_flush();
+    }
+    dentry_store(request.parent_cluster_number, request.name, request.ext, TRUE, 0, 0);
+    file_handle_update(request.parent_cluster_number, i, TRUE, 0);
+    dir_index_remove(index, i);
+    reset_entry(dir_entry_ptr(index, i, TRUE));
+    if (is_tail_packed(current))
+        tail_release(deleted_cluster_number, current.access_date, current.filesize);
+    else
+        release_cluster_chain(deleted_cluster_number);
+    write_fsinfo();
+    return D_REQUEST_SUCCESS_RETURN;
+}
+
+/**
+ * Find file entry of range request in its parent directory
+ *
+ * @param request   Range request
+ * @param index     Output, index of parent directory
+ * @param entry_num Output, entry number of file
+ * @return          0 found, else R_REQUEST_*_RETURN error code
+ */
+static int8_t find_file_entry(struct FAT32DriverRequest request, struct DirectoryIndex **index, int16_t *entry_num) {
+    if (!is_directory_cluster(request.parent_cluster_number)) {
+        return R_REQUEST_UNKNOWN_RETURN;
+    }
+    *index     = dir_index_get(request.parent_cluster_number);
+    *entry_num = dir_index_lookup(*index, request.name, request.ext);
+    if (*entry_num == DIR_INDEX_NONE) {
+        return R_REQUEST_NOT_FOUND_RETURN;
+    }
+    if (dir_entry_ptr(*index, *entry_num, FALSE)->attribute == ATTR_SUBDIRECTORY) {
+        return R_REQUEST_NOT_A_FILE_RETURN;
+    }
+    return R_REQUEST_SUCCESS_RETURN;
+}
+
+// File size in byte, file without exact size recorded (legacy) use its whole chain
+static uint32_t file_entry_size(struct FAT32DirectoryEntry entry) {
+    if (entry.user_attribute & UATTR_FILESIZE_EXACT) {
+        return entry.filesize;
+    }
+    uint32_t chain_length;
+    cluster_chain_last(((uint32_t) entry.cluster_high) << 16 | entry.cluster_low, &chain_length);
+    return chain_length*CLUSTER_SIZE;
+}
+
+/**
+ * Extend file chain so it can hold end byte
+ *
+ * @return FALSE if storage does not have enough free cluster
+ */
+static bool reserve_file_chain(uint32_t first_cluster, uint32_t end) {
+    uint32_t chain_length;
+    uint32_t last_cluster   = cluster_chain_last(first_cluster, &chain_length);
+    uint32_t needed_cluster = (end + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    if (needed_cluster > chain_length) {
+        if (driver_state.free_cluster_count < needed_cluster - chain_length) {
+            return FALSE;
+        }
+        allocate_cluster_chain(last_cluster, needed_cluster - chain_length);
+    }
+    return TRUE;
+}
+
+// Zero fill byte range [from, to) of chain
+static void zero_file_range(uint32_t first_cluster, uint32_t from, uint32_t to) {
+    while (from < to) {
+        uint32_t part = CLUSTER_SIZE - from % CLUSTER_SIZE;
+        if (part > to - from)
+            part = to - from;
+        transfer_cluster_range(first_cluster, from, zero_cluster.buf, part, TRUE);
+        from += part;
+    }
+}
+
+// Record exact size of file entry
+static void set_file_entry_size(struct DirectoryIndex *index, int16_t entry_num, uint32_t filesize) {
+    struct FAT32DirectoryEntry *entry = dir_entry_ptr(index, entry_num, TRUE);
+    entry->filesize        = filesize;
+    entry->user_attribute |= UATTR_FILESIZE_EXACT;
+}
+
+/**
+ * Make first cluster_count clusters of file exclusive before they are modified,
+ * first cluster in directory entry follow duplicated first cluster
+ *
+ * @return Duplicated cluster count, -1 if storage does not have enough free cluster
+ */
+static int32_t unshare_file_entry(struct DirectoryIndex *index, int16_t entry_num, uint32_t cluster_count) {
+    struct FAT32DirectoryEntry *entry = dir_entry_ptr(index, entry_num, FALSE);
+    uint32_t first_cluster = ((uint32_t) entry->cluster_high) << 16 | entry->cluster_low;
+    uint32_t old_first     = first_cluster;
+    int32_t  copied        = unshare_cluster_chain(&first_cluster, cluster_count);
+    if (first_cluster != old_first) {
+        entry = dir_entry_ptr(index, entry_num, TRUE);
+        entry->cluster_high = (uint16_t) (first_cluster >> 16);
+        entry->cluster_low  = (uint16_t) first_cluster;
+    }
+    return copied;
+}
+
+/**
+ * FAT32 read, read a file from file system.
+ *
+ * @param request All attribute will be used for read, buffer_size will limit reading count
+ * @return Error code: 0 success - 1 not a file - 2 not enough buffer - 3 not found - -1 unknown
+ */
+int8_t read(struct FAT32DriverRequest request) {
+    struct DirectoryIndex *index;
+    int16_t entry_num;
+    int8_t retcode = find_file_entry(request, &index, &entry_num);
+    if (retcode != R_REQUEST_SUCCESS_RETURN) {
+        return retcode;
+    }
+
+    /* transfer exactly filesize byte */
+    struct FAT32DirectoryEntry entry = *dir_entry_ptr(index, entry_num, FALSE);
+    uint32_t filesize = file_entry_size(entry);
+    if (request.buffer_size < filesize) {
+        return R_NOT_ENOUGH_BUFFER_RETURN;
+    }
+    read_file_entry(entry, 0, request.buf, filesize);
+    return R_REQUEST_SUCCESS_RETURN;
+}
+
+int8_t read_range(struct FAT32DriverRequest request, uint32_t *transferred) {
+    struct DirectoryIndex *index;
+    int16_t entry_num;
+    *transferred = 0;
+    int8_t retcode = find_file_entry(request, &index, &entry_num);
+    if (retcode != R_REQUEST_SUCCESS_RETURN) {
+        return retcode;
+    }
+
+    struct FAT32DirectoryEntry entry = *dir_entry_ptr(index, entry_num, FALSE);
+    uint32_t filesize = file_entry_size(entry);
+    if (request.offset >= filesize) {
+        return R_REQUEST_SUCCESS_RETURN;
+    }
+    uint32_t length = filesize - request.offset < request.buffer_size ? filesize - request.offset : request.buffer_size;
+    read_file_entry(entry, request.offset, request.buf, length);
+    *transferred = length;
+    return R_REQUEST_SUCCESS_RETURN;
+}
+
+int8_t write_range(struct FAT32DriverRequest request) {
+    struct DirectoryIndex *index;
+    int16_t entry_num;
+    int8_t retcode = find_file_entry(request, &index, &entry_num);
+    if (retcode == R_REQUEST_NOT_FOUND_RETURN) {
+        return W_REQUEST_NOT_FOUND_RETURN;
+    } else if (retcode == R_REQUEST_NOT_A_FILE_RETURN) {
+        return W_REQUEST_NOT_A_FILE_RETURN;
+    } else if (retcode != R_REQUEST_SUCCESS_RETURN) {
+        return W_REQUEST_INVALID_PARENT_RETURN;
+    }
+
+    uint32_t end = request.offset + request.buffer_size;
+    if (!unpack_file_entry(index, entry_num) || unshare_file_entry(index, entry_num, (end + CLUSTER_SIZE - 1) / CLUSTER_SIZE) < 0) {
+        return W_REQUEST_UNKNOWN_RETURN;
+    }
+    struct FAT32DirectoryEntry entry = *dir_entry_ptr(index, entry_num, FALSE);
+    uint32_t first_cluster = ((uint32_t) entry.cluster_high) << 16 | entry.cluster_low;
+    uint32_t filesize      = file_entry_size(entry);
+
+    if (!reserve_file_chain(first_cluster, end)) {
+        return W_REQUEST_UNKNOWN_RETURN;
+    }
+
+    /* zero fill gap between old end of file and offset */
+    zero_file_range(first_cluster, filesize, request.offset);
+    transfer_cluster_range(first_cluster, request.offset, request.buf, request.buffer_size, TRUE);
+
+    set_file_entry_size(index, entry_num, end > filesize ? end : filesize);
+    write_fsinfo();
+    file_handle_update(request.parent_cluster_number, entry_num, FALSE, 0);
+    return W_REQUEST_SUCCESS_RETURN;
+}
+
+int8_t truncate_file(struct FAT32DriverRequest request) {
+    struct DirectoryIndex *index;
+    int16_t entry_num;
+    int8_t retcode = find_file_entry(request, &index, &entry_num);
+    if (retcode == R_REQUEST_NOT_FOUND_RETURN) {
+        return W_REQUEST_NOT_FOUND_RETURN;
+    } else if (retcode == R_REQUEST_NOT_A_FILE_RETURN) {
+        return W_REQUEST_NOT_A_FILE_RETURN;
+    } else if (retcode != R_REQUEST_SUCCESS_RETURN) {
+        return W_REQUEST_INVALID_PARENT_RETURN;
+    }
+
+    /* file keep its first cluster even when empty, last kept cluster get new FAT value */
+    uint32_t new_size     = request.offset;
+    uint32_t keep_cluster = new_size == 0 ? 1 : (new_size + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    if (!unpack_file_entry(index, entry_num) || unshare_file_entry(index, entry_num, keep_cluster) < 0) {
+        return W_REQUEST_UNKNOWN_RETURN;
+    }
+    struct FAT32DirectoryEntry entry = *dir_entry_ptr(index, entry_num, FALSE);
+    uint32_t first_cluster = ((uint32_t) entry.cluster_high) << 16 | entry.cluster_low;
+    uint32_t filesize      = file_entry_size(entry);
+
+    if (new_size > filesize) {
+        if (!reserve_file_chain(first_cluster, new_size)) {
+            return W_REQUEST_UNKNOWN_RETURN;
+        }
+        zero_file_range(first_cluster, filesize, new_size);
+    } else {
+        uint32_t last_kept = first_cluster;
+        for (uint32_t i = 1; i < keep_cluster; i++) {
+            last_kept = get_fat_entry(last_kept);
+        }
+        uint32_t freed_cluster = get_fat_entry(last_kept);
+        set_fat_entry(last_kept, FAT32_FAT_END_OF_FILE);
+        release_cluster_chain(freed_cluster);
+    }
+    set_file_entry_size(index, entry_num, new_size);
+    write_fsinfo();
+    file_handle_update(request.parent_cluster_number, entry_num, FALSE, 0);
+    return W_REQUEST_SUCCESS_RETURN;
+}
+
+int8_t stat_file(struct FAT32DriverRequest request, struct FAT32FileStat *stat) {
+    if (!is_directory_cluster(request.parent_cluster_number)) {
+        return R_REQUEST_UNKNOWN_RETURN;
+    }
+    struct DirectoryIndex *index = dir_index_get(request.parent_cluster_number);
+    int16_t entry_num = dir_index_lookup(index, request.name, request.ext);
+    if (entry_num == DIR_INDEX_NONE) {
+        return R_REQUEST_NOT_FOUND_RETURN;
+    }
+
+    struct FAT32DirectoryEntry entry = *dir_entry_ptr(index, entry_num, FALSE);
+    uint32_t cluster_count;
+    stat->first_cluster  = ((uint32_t) entry.cluster_high) << 16 | entry.cluster_low;
+    stat->attribute      = entry.attribute;
+    stat->user_attribute = entry.user_attribute;
+    cluster_chain_last(stat->first_cluster, &cluster_count);
+    stat->cluster_count  = is_tail_packed(entry) ? 0 : cluster_count;
+    stat->filesize       = entry.attribute == ATTR_SUBDIRECTORY ? 0 : file_entry_size(entry);
+    return R_REQUEST_SUCCESS_RETURN;
+}
+
+/* -- Open File Handle -- */
+static struct FileHandle file_handle_table[FILE_HANDLE_COUNT];
+
+// Append chain starting at cluster to handle, extending extent map while it has room
+static void file_handle_map_chain(struct FileHandle *handle, uint32_t cluster) {
+    while (cluster != FAT32_FAT_END_OF_FILE) {
+        if (handle->mapped_cluster_count == handle->cluster_count) {
+            struct FileExtent *last = &handle->extent[handle->extent_count > 0 ? handle->extent_count - 1 : 0];
+            if (handle->extent_count > 0 && last->disk_cluster + last->length == cluster) {
+                last->length++;
+                handle->mapped_cluster_count++;
+            } else if (handle->extent_count < FILE_EXTENT_MAX_COUNT) {
+                struct FileExtent *extent = &handle->extent[handle->extent_count++];
+                extent->file_cluster = handle->cluster_count;
+                extent->disk_cluster = cluster;
+                extent->length       = 1;
+                handle->mapped_cluster_count++;
+            }
+        }
+        handle->cluster_count++;
+        cluster = get_fat_entry(cluster);
+    }
+}
+
+// Resolve directory entry of handle & rebuild its extent map
+static void file_handle_load(struct FileHandle *handle) {
+    struct DirectoryIndex *index = dir_index_get(handle->parent_cluster_number);
+    struct FAT32DirectoryEntry entry = *dir_entry_ptr(index, handle->entry_num, FALSE);
+    handle->filesize             = file_entry_size(entry);
+    handle->cluster_count        = 0;
+    handle->mapped_cluster_count = 0;
+    handle->extent_count         = 0;
+    handle->tail_cluster         = 0;
+    if (is_tail_packed(entry)) {
+        handle->tail_cluster = ((uint32_t) entry.cluster_high) << 16 | entry.cluster_low;
+        handle->tail_offset  = entry.access_date;
+        return;
+    }
+    file_handle_map_chain(handle, ((uint32_t) entry.cluster_high) << 16 | entry.cluster_low);
+}
+
+// Last cluster of extent map
+static uint32_t file_handle_last_mapped(struct FileHandle *handle) {
+    struct FileExtent last = handle->extent[handle->extent_count - 1];
+    return last.disk_cluster + last.length - 1;
+}
+
+/**
+ * Transfer byte range of open file, file chain must be long enough to hold the range.
+ * Extent holding offset is found with binary search, every extent is transferred without FAT access
+ */
+static void file_handle_transfer(struct FileHandle *handle, uint32_t offset, uint8_t *buf, uint32_t length, bool is_write) {
+    if (handle->tail_cluster != 0) {
+        transfer_partial_cluster(handle->tail_cluster, handle->tail_offset + offset, buf, length, is_write);
+        return;
+    }
+    while (length > 0) {
+        uint32_t file_cluster = offset / CLUSTER_SIZE;
+        if (file_cluster >= handle->mapped_cluster_count) {
+            /* chain past extent map is walked from last mapped cluster */
+            transfer_cluster_range(file_handle_last_mapped(handle),
+                                    offset - (handle->mapped_cluster_count - 1)*CLUSTER_SIZE, buf, length, is_write);
+            return;
+        }
+
+        uint32_t low  = 0;
+        uint32_t high = handle->extent_count - 1;
+        while (low < high) {
+            uint32_t mid = (low + high + 1) / 2;
+            if (handle->extent[mid].file_cluster <= file_cluster)
+                low  = mid;
+            else
+                high = mid - 1;
+        }
+        struct FileExtent extent = handle->extent[low];
+        uint32_t run_offset = offset - extent.file_cluster*CLUSTER_SIZE;
+        uint32_t part       = extent.length*CLUSTER_SIZE - run_offset;
+        if (part > length)
+            part = length;
+        transfer_cluster_run(extent.disk_cluster, run_offset, buf, part, is_write);
+        buf    += part;
+        offset += part;
+        length -= part;
+    }
+}
+
+// Extend file chain of handle so it can hold end byte, FALSE if storage does not have enough free cluster
+static bool file_handle_reserve(struct FileHandle *handle, uint32_t end) {
+    uint32_t needed_cluster = (end + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    if (needed_cluster <= handle->cluster_count) {
+        return TRUE;
+    }
+    if (driver_state.free_cluster_count < needed_cluster - handle->cluster_count) {
+        return FALSE;
+    }
+    uint32_t last_cluster = file_handle_last_mapped(handle);
+    if (handle->mapped_cluster_count != handle->cluster_count) {
+        uint32_t tail_length;
+        last_cluster = cluster_chain_last(last_cluster, &tail_length);
+    }
+    file_handle_map_chain(handle, allocate_cluster_chain(last_cluster, needed_cluster - handle->cluster_count));
+    return TRUE;
+}
+
+static void file_handle_update(uint32_t parent_cluster, int16_t entry_num, bool is_deleted, const struct FileHandle *origin) {
+    for (uint32_t i = 0; i < FILE_HANDLE_COUNT; i++) {
+        struct FileHandle *handle = &file_handle_table[i];
+        if (!handle->used || handle == origin || handle->parent_cluster_number != parent_cluster 
+                || handle->entry_num != entry_num) {
+            continue;
+        }
+        if (is_deleted)
+            handle->used = FALSE;
+        else
+            file_handle_load(handle);
+    }
+}
+
+static struct FileHandle* file_handle_get(int32_t fd) {
+    if (fd < 0 || fd >= FILE_HANDLE_COUNT || !file_handle_table[fd].used) {
+        return 0;
+    }
+    return &file_handle_table[fd];
+}
+
+int8_t open_file(struct FAT32DriverRequest request, int32_t *fd) {
+    struct DirectoryIndex *index;
+    int16_t entry_num;
+    int8_t retcode = find_file_entry(request, &index, &entry_num);
+    if (retcode != R_REQUEST_SUCCESS_RETURN) {
+        return retcode;
+    }
+
+    for (int32_t i = 0; i < FILE_HANDLE_COUNT; i++) {
+        struct FileHandle *handle = &file_handle_table[i];
+        if (!handle->used) {
+            handle->used                  = TRUE;
+            handle->parent_cluster_number = request.parent_cluster_number;
+            handle->entry_num             = entry_num;
+            handle->position              = 0;
+            file_handle_load(handle);
+            *fd = i;
+            return R_REQUEST_SUCCESS_RETURN;
+        }
+    }
+    return R_REQUEST_UNKNOWN_RETURN;
+}
+
+int8_t read_file(int32_t fd, void *buf, uint32_t size, uint32_t *transferred) {
+    struct FileHandle *handle = file_handle_get(fd);
+    *transferred = 0;
+    if (handle == 0) {
+        return R_REQUEST_UNKNOWN_RETURN;
+    }
+
+    if (handle->position < handle->filesize) {
+        *transferred = handle->filesize - handle->position;
+        if (*transferred > size)
+            *transferred = size;
+    }
+    file_handle_transfer(handle, handle->position, buf, *transferred, FALSE);
+    handle->position += *transferred;
+    return R_REQUEST_SUCCESS_RETURN;
+}
+
+int8_t write_file(int32_t fd, const void *buf, uint32_t size) {
+    struct FileHandle *handle = file_handle_get(fd);
+    if (handle == 0) {
+        return W_REQUEST_UNKNOWN_RETURN;
+    }
+    if (handle->tail_cluster != 0) {
+        if (!unpack_file_entry(dir_index_get(handle->parent_cluster_number), handle->entry_num)) {
+            return W_REQUEST_UNKNOWN_RETURN;
+        }
+        file_handle_load(handle);
+    }
+    uint32_t end    = handle->position + size;
+    int32_t  copied = unshare_file_entry(dir_index_get(handle->parent_cluster_number), handle->entry_num, 
+                                         (end + CLUSTER_SIZE - 1) / CLUSTER_SIZE);
+    if (copied < 0) {
+        return W_REQUEST_UNKNOWN_RETURN;
+    } else if (copied > 0) {
+        file_handle_load(handle);
+    }
+    if (!file_handle_reserve(handle, end)) {
+        return W_REQUEST_UNKNOWN_RETURN;
+    }
+
+    /* zero fill gap between old end of file and position */
+    while (handle->filesize < handle->position) {
+        uint32_t part = handle->position - handle->filesize;
+        if (part > CLUSTER_SIZE)
+            part = CLUSTER_SIZE;
+        file_handle_transfer(handle, handle->filesize, zero_cluster.buf, part, TRUE);
+        handle->filesize += part;
+    }
+    file_handle_transfer(handle, handle->position, (uint8_t*) buf, size, TRUE);
+
+    if (end > handle->filesize)
+        handle->filesize = end;
+    handle->position = end;
+    set_file_entry_size(dir_index_get(handle->parent_cluster_number), handle->entry_num, handle->filesize);
+    write_fsinfo();
+    file_handle_update(handle->parent_cluster_number, handle->entry_num, FALSE, handle);
+    return W_REQUEST_SUCCESS_RETURN;
+}
+
+int8_t seek_file(int32_t fd, int32_t offset, uint8_t whence, uint32_t *position) {
+    struct FileHandle *handle = file_handle_get(fd);
+    if (handle == 0) {
+        return R_REQUEST_UNKNOWN_RETURN;
+    }
+
+    uint32_t base;
+    if (whence == FILE_SEEK_SET)
+        base = 0;
+    else if (whence == FILE_SEEK_CUR)
+        base = handle->position;
+    else if (whence == FILE_SEEK_END)
+        base = handle->filesize;
+    else
+        return R_REQUEST_UNKNOWN_RETURN;
+    if (offset < 0 && (uint32_t) -offset > base) {
+        return R_REQUEST_UNKNOWN_RETURN;
+    }
+    handle->position = base + offset;
+    *position        = handle->position;
+    return R_REQUEST_SUCCESS_RETURN;
+}
+
+int8_t close_file(int32_t fd) {
+    struct FileHandle *handle = file_handle_get(fd);
+    if (handle == 0) {
+        return R_REQUEST_UNKNOWN_RETURN;
+    }
+    handle->used = FALSE;
+    return R_REQUEST_SUCCESS_RETURN;
+}
+
+// TRUE if directory cluster is dir itself or any directory below it
+static bool is_inside_directory(uint32_t cluster, uint32_t dir) {
+    for (uint32_t ancestor = cluster; ancestor != ROOT_CLUSTER_NUMBER; ) {
+        if (ancestor == dir) {
+            return TRUE;
+        }
+        struct FAT32DirectoryEntry self = *(struct FAT32DirectoryEntry*) cache_get_block(cluster_to_lba(ancestor), FALSE);
+        ancestor = ((uint32_t) self.cluster_high) << 16 | self.cluster_low;
+    }
+    return dir == ROOT_CLUSTER_NUMBER;
+}
+
+/**
+ * Add prepared entry into directory, growing it if full, and register it in dentry cache & name index
+ *
+ * @return Entry number of new entry, DIR_INDEX_NONE if directory cannot grow or entry cannot be indexed
+ */
+static int16_t dir_insert_entry(uint32_t parent_cluster, struct FAT32DirectoryEntry entry) {
+    struct DirectoryIndex *index = dir_index_get(parent_cluster);
+    if (index->free_head == DIR_INDEX_NONE && !dir_index_grow(index)) {
+        return DIR_INDEX_NONE;
+    }
+    if (insert_index(entry.name, entry.ext, parent_cluster) != 0) {
+        return DIR_INDEX_NONE;
+    }
+    int16_t entry_num = dir_index_insert(index, entry.name, entry.ext);
+    *dir_entry_ptr(index, entry_num, TRUE) = entry;
+    dir_entry_ptr(index, 0, TRUE)->user_attribute = UATTR_NOT_EMPTY;
+    dentry_store(parent_cluster, entry.name, entry.ext, FALSE, entry.attribute, 
+                    ((uint32_t) entry.cluster_high) << 16 | entry.cluster_low);
+    return entry_num;
+}
+
+int8_t rename_entry(struct FAT32DriverRequest source, struct FAT32DriverRequest dest) {
+    if (!is_directory_cluster(source.parent_cluster_number) || !is_directory_cluster(dest.parent_cluster_number)) {
+        return MV_REQUEST_INVALID_PARENT_RETURN;
+    }
+    struct DirectoryIndex *index = dir_index_get(source.parent_cluster_number);
+    int16_t source_num = dir_index_lookup(index, source.name, source.ext);
+    if (source_num == DIR_INDEX_NONE) {
+        return MV_REQUEST_NOT_FOUND_RETURN;
+    }
+    struct FAT32DirectoryEntry entry = *dir_entry_ptr(index, source_num, FALSE);
+    uint32_t cluster = ((uint32_t) entry.cluster_high) << 16 | entry.cluster_low;
+
+    index = dir_index_get(dest.parent_cluster_number);
+    if (dir_index_lookup(index, dest.name, dest.ext) != DIR_INDEX_NONE) {
+        return MV_REQUEST_ALREADY_EXIST_RETURN;
+    }
+    if (entry.attribute == ATTR_SUBDIRECTORY && is_inside_directory(dest.parent_cluster_number, cluster)) {
+        return MV_REQUEST_INTO_ITSELF_RETURN;
+    }
+
+    /* new entry first, index of source parent is fetched again as dest may evict it */
+    memcpy(entry.name, dest.name, 8);
+    memcpy(entry.ext, dest.ext, 3);
+    int16_t dest_num = dir_insert_entry(dest.parent_cluster_number, entry);
+    if (dest_num == DIR_INDEX_NONE) {
+        return MV_REQUEST_UNKNOWN_RETURN;
+    }
+
+    index = dir_index_get(source.parent_cluster_number);
+    dir_index_remove(index, source_num);
+    reset_entry(dir_entry_ptr(index, source_num, TRUE));
+
+    if (entry.attribute == ATTR_SUBDIRECTORY) {
+        struct FAT32DirectoryEntry *self = (struct FAT32DirectoryEntry*) cache_get_block(cluster_to_lba(cluster), TRUE);
+        memcpy(self->name, dest.name, 8);
+        self->cluster_high = (uint16_t) (dest.parent_cluster_number >> 16);
+        self->cluster_low  = (uint16_t) dest.parent_cluster_number;
+        dir_path_cache_flush();
+    }
+    dentry_store(source.parent_cluster_number, source.name, source.ext, TRUE, 0, 0);
+    delete_index(source.name, source.ext, source.parent_cluster_number);
+
+    for (uint32_t i = 0; i < FILE_HANDLE_COUNT; i++) {
+        struct FileHandle *handle = &file_handle_table[i];
+        if (handle->used && handle->parent_cluster_number == source.parent_cluster_number 
+                && handle->entry_num == source_num) {
+            handle->parent_cluster_number = dest.parent_cluster_number;
+            handle->entry_num             = dest_num;
+        }
+    }
+    write_fsinfo();
+    return MV_REQUEST_SUCCESS_RETURN;
+}
+
+// Tail packed file is small, its data is simply written again. Kept out of copy_entry() recursion frame
+static int8_t copy_packed_file(struct FAT32DirectoryEntry entry, struct FAT32DriverRequest dest) {
+    uint8_t *data = kmalloc(entry.filesize);
+    if (data == 0) {
+        return CP_REQUEST_UNKNOWN_RETURN;
+    }
+    uint32_t cluster = ((uint32_t) entry.cluster_high) << 16 | entry.cluster_low;
+    transfer_partial_cluster(cluster, entry.access_date, data, entry.filesize, FALSE);
+    dest.buf         = data;
+    dest.buffer_size = entry.filesize;
+    int8_t retcode   = write(dest);
+    kfree(data);
+    return retcode == W_REQUEST_SUCCESS_RETURN ? CP_REQUEST_SUCCESS_RETURN : CP_REQUEST_UNKNOWN_RETURN;
+}
+
+int8_t copy_entry(struct FAT32DriverRequest source, struct FAT32DriverRequest dest, bool full_copy) {
+    if (!is_directory_cluster(source.parent_cluster_number) || !is_directory_cluster(dest.parent_cluster_number)) {
+        return CP_REQUEST_INVALID_PARENT_RETURN;
+    }
+    struct DirectoryIndex *index = dir_index_get(source.parent_cluster_number);
+    int16_t source_num = dir_index_lookup(index, source.name, source.ext);
+    if (source_num == DIR_INDEX_NONE) {
+        return CP_REQUEST_NOT_FOUND_RETURN;
+    }
+    struct FAT32DirectoryEntry entry = *dir_entry_ptr(index, source_num, FALSE);
+    uint32_t cluster = ((uint32_t) entry.cluster_high) << 16 | entry.cluster_low;
+
+    index = dir_index_get(dest.parent_cluster_number);
+    if (dir_index_lookup(index, dest.name, dest.ext) != DIR_INDEX_NONE) {
+        return CP_REQUEST_ALREADY_EXIST_RETURN;
+    }
+    if (index->free_head == DIR_INDEX_NONE && driver_state.free_cluster_count == 0) {
+        return CP_REQUEST_UNKNOWN_RETURN;
+    }
+
+    if (entry.attribute == ATTR_SUBDIRECTORY) {
+        if (is_inside_directory(dest.parent_cluster_number, cluster)) {
+            return CP_REQUEST_INTO_ITSELF_RETURN;
+        }
+        struct FAT32DriverRequest child = dest;
+        child.buffer_size = 0;
+        if (write(child) != W_REQUEST_SUCCESS_RETURN) {
+            return CP_REQUEST_UNKNOWN_RETURN;
+        }
+        uint32_t copy_cluster;
+        uint8_t  attribute;
+        lookup_child(dest.parent_cluster_number, dest.name, dest.ext, &copy_cluster, &attribute);
+
+        /* copy every child, source index is fetched again as recursion may evict it */
+        for (uint32_t i = 1; i < dir_index_get(cluster)->entry_count; i++) {
+            struct FAT32DirectoryEntry current = *dir_entry_ptr(dir_index_get(cluster), i, FALSE);
+            if (memcmp(current.name, "\0\0\0\0\0\0\0\0", 8) == 0 && memcmp(current.ext, "\0\0\0", 3) == 0) {
+                continue;
+            }
+            memcpy(child.name, current.name, 8);
+            memcpy(child.ext, current.ext, 3);
+            child.parent_cluster_number = cluster;
+            struct FAT32DriverRequest child_dest = child;
+            child_dest.parent_cluster_number = copy_cluster;
+            int8_t retcode = copy_entry(child, child_dest, full_copy);
+            if (retcode != CP_REQUEST_SUCCESS_RETURN) {
+                return retcode;
             }
+        }
+        return CP_REQUEST_SUCCESS_RETURN;
     }
-    return found_count;
+
+    if (is_tail_packed(entry)) {
+        return copy_packed_file(entry, dest);
+    }
+
+    /* file share source chain, full copy or saturated share duplicate it */
+    uint32_t copy_cluster = cluster;
+    if (full_copy || !share_cluster_chain(cluster)) {
+        uint32_t chain_length;
+        cluster_chain_last(cluster, &chain_length);
+        if (driver_state.free_cluster_count < chain_length + 1) {
+            return CP_REQUEST_UNKNOWN_RETURN;
+        }
+        copy_cluster = duplicate_cluster_chain(cluster, chain_length);
+    }
+    memcpy(entry.name, dest.name, 8);
+    memcpy(entry.ext, dest.ext, 3);
+    entry.cluster_high = (uint16_t) (copy_cluster >> 16);
+    entry.cluster_low  = (uint16_t) copy_cluster;
+    if (dir_insert_entry(dest.parent_cluster_number, entry) == DIR_INDEX_NONE) {
+        release_cluster_chain(copy_cluster);
+        write_fsinfo();
+        return CP_REQUEST_UNKNOWN_RETURN;
+    }
+    write_fsinfo();
+    return CP_REQUEST_SUCCESS_RETURN;
 }
 
-int delete_index(char* name, char* ext, uint32_t parent_cluster_number) {
-    struct IndexTable index_table;
-    read_clusters(&driver_state.fat_table, FAT_CLUSTER_NUMBER, 1);
-    read_clusters(&index_table, INDEX_CLUSTER_NUMBER, sizeof(struct IndexTable)/ CLUSTER_SIZE);
-    int entry_count = driver_state.fat_table.cluster_map[INDEX_CLUSTER_NUMBER];
-    int i = 0;
-    int found = 0;
-    for (i = 0; i < entry_count; i++) {
-        struct IndexEntry entry = index_table.buf[i];
-        if (memcmp(entry.name, name, 8) == 0 &&
-            memcmp(entry.ext, ext, 3) == 0 && 
-            entry.parent_cluster_number == parent_cluster_number ) {
-                    found = 1;
+void initialize_root(void){
+    struct FAT32DirectoryTable root = {0};
+    init_directory_table(&root, "root\0\0\0\0", ROOT_CLUSTER_NUMBER);
+    // root.table[0].attribute = ATTR_SUBDIRECTORY;
+    memcpy(root.table[0].ext, "dir", 3);
+
+    // save to memory?
+    write_clusters(&root, ROOT_CLUSTER_NUMBER, 1);
+}   
+
+void reset_entry(struct FAT32DirectoryEntry *entry){
+    memcpy(entry->name, "\0\0\0\0\0\0\0\0", 8);
+    memcpy(entry->ext, "\0\0\0", 3);
+    entry->attribute = 0;
+    entry->undelete = 0;
+    entry->filesize = 0;
+    entry->cluster_high = 0;
+    entry->cluster_low = 0;
+}
+
+void get_dir_path(char* buffer, uint32_t directory_cluster_number) {
+    dir_path_build(buffer, directory_cluster_number, 0);
+}
+
+uint32_t get_dir_path_batch(struct DirPathBatchRequest request) {
+    char path[DIR_PATH_MAX_LENGTH];
+    uint32_t offset = 0;
+    uint32_t i;
+    for (i = 0; i < request.count; i++) {
+        uint32_t length = dir_path_build(path, request.clusters[i], 0);
+        if (offset + length + 1 > request.buffer_size)
+            break;
+        memcpy(request.buf + offset, path, length + 1);
+        offset += length + 1;
+    }
+    return i;
+}
+
+void get_children(char* buffer, uint32_t buffer_size, uint32_t directory_cluster_number, uint32_t *cursor) {
+    uint32_t idx = 0;
+    buffer[0] = '\0';
+    if (!is_directory_cluster(directory_cluster_number)) {
+        if (cursor != 0)
+            *cursor = 0;
+        return;
+    }
+
+    /* stream entry along directory chain, one line is at most 8 + 5 + 1 char */
+    struct DirectoryIndex *index = dir_index_get(directory_cluster_number);
+    uint32_t i = (cursor != 0 && *cursor != 0) ? *cursor : 1;
+    for (; i < index->entry_count && idx + 14 < buffer_size; i++) {
+        struct FAT32DirectoryEntry current_child = *dir_entry_ptr(index, i, FALSE);
+        bool current_child_name_na = memcmp(current_child.name, "\0\0\0\0\0\0\0\0", 8) == 0;
+        bool current_child_ext_na = memcmp(current_child.ext, "\0\0\0", 3) == 0;
+        if (current_child_name_na && current_child_ext_na) {
+            continue;
+        } else {
+            for (int j = 0; j < 8; j++) {
+                if (current_child.name[j] == '\0') {
                     break;
+                }
+                buffer[idx] = current_child.name[j];
+                idx++;
+            }
+            if (current_child_ext_na) {
+                memcpy(buffer + idx, ".file", 5);
+                idx += 5;
+            } else if (memcmp(current_child.ext, "dir", 3) != 0) {
+                buffer[idx] = '.';
+                idx++;
+                for (int j = 0; j < 3; j++) {
+                    if (current_child.ext[j] == '\0') {
+                        break;
+                    }
+                    buffer[idx] = current_child.ext[j];
+                    idx++;
+                }
+            }
+        }
+        buffer[idx] = '\n';
+        idx++;
+    }
+    buffer[idx] = '\0';
+    if (cursor != 0)
+        *cursor = i < index->entry_count ? i : 0;
+}
+
+uint32_t move_to_child_directory(struct FAT32DriverRequest request) {
+    if (!is_directory_cluster(request.parent_cluster_number)) {
+        return 0;
+    }
+    uint32_t cluster;
+    uint8_t  attribute;
+    if (!lookup_child(request.parent_cluster_number, request.name, "dir", &cluster, &attribute)) {
+        return 0;
+    }
+    return cluster;
+}
+
+uint32_t move_to_parent_directory(struct FAT32DriverRequest request) {
+    struct FAT32DirectoryEntry *self = (struct FAT32DirectoryEntry*) cache_get_block(cluster_to_lba(request.parent_cluster_number), FALSE);
+    return ((uint32_t) self->cluster_high) << 16 | self->cluster_low;
+}
+
+uint32_t resolve_path(const char *path, uint32_t start_cluster) {
+    uint32_t current = path[0] == '/' ? ROOT_CLUSTER_NUMBER : start_cluster;
+    if (!is_directory_cluster(current)) {
+        return 0;
+    }
+
+    const char *p = path;
+    while (*p != '\0') {
+        while (*p == '/')
+            p++;
+        const char *component = p;
+        while (*p != '\0' && *p != '/')
+            p++;
+        uint32_t length = p - component;
+        if (length == 0 || (length == 1 && component[0] == '.')) {
+            continue;
+        }
+        if (length == 2 && component[0] == '.' && component[1] == '.') {
+            struct FAT32DirectoryEntry *self = (struct FAT32DirectoryEntry*) cache_get_block(cluster_to_lba(current), FALSE);
+            current = ((uint32_t) self->cluster_high) << 16 | self->cluster_low;
+            continue;
+        }
+
+        /* split component into 8.3 name, component without extension is directory */
+        char name[8] = {0};
+        char ext[3]  = {'d', 'i', 'r'};
+        uint32_t name_length = 0;
+        while (name_length < length && component[name_length] != '.')
+            name_length++;
+        uint32_t ext_length = name_length < length ? length - name_length - 1 : 0;
+        if (name_length > 8 || ext_length > 3) {
+            return 0;
+        }
+        memcpy(name, component, name_length);
+        if (name_length < length) {
+            memset(ext, 0, 3);
+            memcpy(ext, component + name_length + 1, ext_length);
+        }
+
+        uint32_t cluster;
+        uint8_t  attribute;
+        if (!lookup_child(current, name, ext, &cluster, &attribute) || attribute != ATTR_SUBDIRECTORY) {
+            return 0;
+        }
+        current = cluster;
+    }
+    return current;
+}
+
+// B+tree node occupy first INDEX_NODE_SIZE byte of its cluster
+static void index_node_read(struct IndexNode *node, uint32_t cluster) {
+    cache_read_blocks(node, cluster_to_lba(cluster), INDEX_NODE_SIZE / BLOCK_SIZE);
+}
+
+static void index_node_write(const struct IndexNode *node, uint32_t cluster) {
+    cache_write_blocks(node, cluster_to_lba(cluster), INDEX_NODE_SIZE / BLOCK_SIZE);
+}
+
+void init_index_file() {
+    struct IndexNode root = {0};
+    root.is_leaf = 1;
+    index_node_write(&root, INDEX_CLUSTER_NUMBER);
+    for (uint32_t i = 0; i < INDEX_LEGACY_CLUSTER_COUNT; i++) {
+        set_fat_entry(INDEX_CLUSTER_NUMBER + i, FAT32_FAT_END_OF_FILE);
+    }
+    driver_state.index_root_cluster = INDEX_CLUSTER_NUMBER;
+    write_fsinfo();
+}
+
+// Move entries of legacy flat IndexTable into B+tree
+static void migrate_legacy_index(void) {
+    struct IndexTable *legacy = kmalloc(sizeof(struct IndexTable));
+    if (legacy == 0) {
+        // Index only accelerate search, start empty rather than leaving volume without index
+        init_index_file();
+        return;
+    }
+    uint32_t entry_count = get_fat_entry(INDEX_CLUSTER_NUMBER);
+    uint32_t capacity    = INDEX_LEGACY_CLUSTER_COUNT*CLUSTER_SIZE / sizeof(struct IndexEntry);
+    if (entry_count > capacity)
+        entry_count = capacity;
+    read_clusters(legacy, INDEX_CLUSTER_NUMBER, INDEX_LEGACY_CLUSTER_COUNT);
+
+    init_index_file();
+    for (uint32_t i = 0; i < entry_count; i++) {
+        insert_index(legacy->buf[i].name, legacy->buf[i].ext, legacy->buf[i].parent_cluster_number);
+    }
+    kfree(legacy);
+}
+
+static int index_key_compare(const struct IndexEntry *a, const struct IndexEntry *b) {
+    int cmp = memcmp(a->name, b->name, 8);
+    if (cmp == 0)
+        cmp = memcmp(a->ext, b->ext, 3);
+    if (cmp == 0 && a->parent_cluster_number != b->parent_cluster_number)
+        cmp = a->parent_cluster_number < b->parent_cluster_number ? -1 : 1;
+    return cmp;
+}
+
+// Number of key in node less than key, or less than or equal if inclusive
+static uint16_t index_node_bound(const struct IndexNode *node, const struct IndexEntry *key, bool inclusive) {
+    uint16_t low  = 0;
+    uint16_t high = node->key_count;
+    while (low < high) {
+        uint16_t mid = (low + high) / 2;
+        int cmp      = index_key_compare(&node->key[mid], key);
+        if (cmp < 0 || (inclusive && cmp == 0))
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+/**
+ * Descend from root into leaf that may contain key
+ *
+ * @param key  Searched key
+ * @param node Output, loaded leaf
+ * @param pos  Output, position of first key in leaf not less than key
+ * @return     Leaf cluster number
+ */
+static uint32_t index_find_leaf(const struct IndexEntry *key, struct IndexNode *node, uint16_t *pos) {
+    uint32_t cluster = driver_state.index_root_cluster;
+    index_node_read(node, cluster);
+    while (!node->is_leaf) {
+        cluster = node->child[index_node_bound(node, key, TRUE)];
+        index_node_read(node, cluster);
+    }
+    *pos = index_node_bound(node, key, FALSE);
+    return cluster;
+}
+
+/**
+ * Insert key into subtree, node is written only if changed.
+ * Every level share same scratch node, internal node is read again if its child is split
+ *
+ * @param cluster       Subtree root
+ * @param key           Inserted key
+ * @param split_key     Output, first key of new right sibling if node is split
+ * @param split_cluster Output, new right sibling if node is split
+ * @param node          Scratch, array of 2 IndexNode (node & its new sibling)
+ * @return              TRUE if node is split and parent must insert split_key
+ */
+static bool index_insert_node(uint32_t cluster, const struct IndexEntry *key, 
+        struct IndexEntry *split_key, uint32_t *split_cluster, struct IndexNode *node) {
+    index_node_read(node, cluster);
+    if (node->is_leaf) {
+        uint16_t pos = index_node_bound(node, key, FALSE);
+        if (pos < node->key_count && index_key_compare(&node->key[pos], key) == 0)
+            return FALSE;
+        memmove(&node->key[pos + 1], &node->key[pos], (node->key_count - pos)*sizeof(struct IndexEntry));
+        node->key[pos] = *key;
+    } else {
+        uint16_t pos = index_node_bound(node, key, TRUE);
+        struct IndexEntry child_split_key;
+        uint32_t child_split_cluster;
+        if (!index_insert_node(node->child[pos], key, &child_split_key, &child_split_cluster, node))
+            return FALSE;
+        index_node_read(node, cluster);
+        memmove(&node->key[pos + 1], &node->key[pos], (node->key_count - pos)*sizeof(struct IndexEntry));
+        memmove(&node->child[pos + 2], &node->child[pos + 1], (node->key_count - pos)*sizeof(uint32_t));
+        node->key[pos]       = child_split_key;
+        node->child[pos + 1] = child_split_cluster;
+    }
+    node->key_count++;
+
+    if (node->key_count <= INDEX_NODE_MAX_KEY) {
+        index_node_write(node, cluster);
+        return FALSE;
+    }
+
+    /* split, leaf copy its middle key up while internal node move it up */
+    struct IndexNode *sibling = &node[1];
+    memset(sibling, 0, sizeof(struct IndexNode));
+    uint16_t mid       = node->key_count / 2;
+    sibling->is_leaf   = node->is_leaf;
+    *split_cluster     = get_empty_cluster();
+    if (node->is_leaf) {
+        sibling->key_count = node->key_count - mid;
+        memcpy(sibling->key, &node->key[mid], sibling->key_count*sizeof(struct IndexEntry));
+        sibling->next_leaf = node->next_leaf;
+        node->next_leaf    = *split_cluster;
+        *split_key         = node->key[mid];
+    } else {
+        sibling->key_count = node->key_count - mid - 1;
+        memcpy(sibling->key, &node->key[mid + 1], sibling->key_count*sizeof(struct IndexEntry));
+        memcpy(sibling->child, &node->child[mid + 1], (sibling->key_count + 1)*sizeof(uint32_t));
+        *split_key         = node->key[mid];
+    }
+    node->key_count = mid;
+    index_node_write(sibling, *split_cluster);
+    index_node_write(node, cluster);
+    return TRUE;
+}
+
+int8_t insert_index(char* name, char* ext, uint32_t parent_cluster_number) {
+    /* split along whole path may allocate 1 cluster per level */
+    if (driver_state.free_cluster_count < INDEX_MAX_HEIGHT) {
+        return -1;
+    }
+    struct IndexNode *scratch = kmalloc(2*sizeof(struct IndexNode));
+    if (scratch == 0) {
+        return -1;
+    }
+
+    struct IndexEntry key;
+    memcpy(key.name, name, 8);
+    memcpy(key.ext, ext, 3);
+    key.parent_cluster_number = parent_cluster_number;
+
+    struct IndexEntry split_key;
+    uint32_t split_cluster;
+    if (index_insert_node(driver_state.index_root_cluster, &key, &split_key, &split_cluster, scratch)) {
+        struct IndexNode *root = scratch;
+        memset(root, 0, sizeof(struct IndexNode));
+        root->key_count = 1;
+        root->key[0]    = split_key;
+        root->child[0]  = driver_state.index_root_cluster;
+        root->child[1]  = split_cluster;
+        driver_state.index_root_cluster = get_empty_cluster();
+        index_node_write(root, driver_state.index_root_cluster);
+    }
+    kfree(scratch);
+    write_fsinfo();
+    return 0;
+}
+
+uint32_t search_index(uint32_t* buffer, uint32_t buffer_count, char* name, char* ext) {
+    struct IndexEntry key = {0};
+    memcpy(key.name, name, 8);
+    memcpy(key.ext, ext, 3);
+
+    struct IndexNode *node = kmalloc(sizeof(struct IndexNode));
+    if (node == 0)
+        return 0;
+    uint16_t pos;
+    index_find_leaf(&key, node, &pos);
+    uint32_t found_count = 0;
+    while (found_count < buffer_count) {
+        for (; pos < node->key_count && found_count < buffer_count; pos++) {
+            if (memcmp(node->key[pos].name, name, 8) != 0 || memcmp(node->key[pos].ext, ext, 3) != 0)
+                break;
+            buffer[found_count++] = node->key[pos].parent_cluster_number;
+        }
+        if (pos < node->key_count || node->next_leaf == 0)
+            break;
+        index_node_read(node, node->next_leaf);
+        pos = 0;
+    }
+    kfree(node);
+    return found_count;
+}
+
+// Match text against pattern with '*' & '?' wildcard
+static bool glob_match(const char *pattern, const char *text) {
+    while (*pattern != '\0') {
+        if (*pattern == '*') {
+            for (const char *t = text; ; t++) {
+                if (glob_match(pattern + 1, t))
+                    return TRUE;
+                if (*t == '\0')
+                    return FALSE;
             }
+        }
+        if (*text == '\0' || (*pattern != '?' && *pattern != *text))
+            return FALSE;
+        pattern++;
+        text++;
+    }
+    return *text == '\0';
+}
+
+// Format entry as "name.ext", or "name" if ext is not wanted
+static void index_entry_text(const struct IndexEntry *entry, bool with_ext, char *text) {
+    int len = 0;
+    for (int i = 0; i < 8 && entry->name[i] != '\0'; i++)
+        text[len++] = entry->name[i];
+    if (with_ext) {
+        text[len++] = '.';
+        for (int i = 0; i < 3 && entry->ext[i] != '\0'; i++)
+            text[len++] = entry->ext[i];
+    }
+    text[len] = '\0';
+}
+
+uint32_t search_index_pattern(struct IndexEntry *buffer, uint32_t buffer_count, const char *pattern) {
+    bool with_ext = FALSE;
+    for (const char *p = pattern; *p != '\0'; p++) {
+        if (*p == '.')
+            with_ext = TRUE;
     }
-    if (!found) {
+
+    /* literal prefix of name limit scanned key range */
+    struct IndexEntry key = {0};
+    int prefix_length = 0;
+    while (prefix_length < 8 && pattern[prefix_length] != '\0' && pattern[prefix_length] != '*'
+            && pattern[prefix_length] != '?' && pattern[prefix_length] != '.') {
+        key.name[prefix_length] = pattern[prefix_length];
+        prefix_length++;
+    }
+
+    struct IndexNode *node = kmalloc(sizeof(struct IndexNode));
+    if (node == 0)
         return 0;
+    uint16_t pos;
+    index_find_leaf(&key, node, &pos);
+    uint32_t found_count = 0;
+    char text[8 + 1 + 3 + 1];
+    bool out_of_prefix = FALSE;
+    while (found_count < buffer_count && !out_of_prefix) {
+        for (; pos < node->key_count && found_count < buffer_count; pos++) {
+            if (memcmp(node->key[pos].name, key.name, prefix_length) != 0) {
+                out_of_prefix = TRUE;
+                break;
+            }
+            index_entry_text(&node->key[pos], with_ext, text);
+            if (glob_match(pattern, text))
+                buffer[found_count++] = node->key[pos];
+        }
+        if (out_of_prefix || node->next_leaf == 0)
+            break;
+        index_node_read(node, node->next_leaf);
+        pos = 0;
     }
-    for (;i < entry_count - 1; i++) {
-        index_table.buf[i] = index_table.buf[i + 1];
+    kfree(node);
+    return found_count;
+}
+
+int delete_index(char* name, char* ext, uint32_t parent_cluster_number) {
+    struct IndexEntry key;
+    memcpy(key.name, name, 8);
+    memcpy(key.ext, ext, 3);
+    key.parent_cluster_number = parent_cluster_number;
+
+    struct IndexNode *node = kmalloc(sizeof(struct IndexNode));
+    if (node == 0)
+        return -1;
+    uint16_t pos;
+    uint32_t cluster = index_find_leaf(&key, node, &pos);
+    if (pos < node->key_count && index_key_compare(&node->key[pos], &key) == 0) {
+        memmove(&node->key[pos], &node->key[pos + 1], (node->key_count - pos - 1)*sizeof(struct IndexEntry));
+        node->key_count--;
+        index_node_write(node, cluster);
     }
-    driver_state.fat_table.cluster_map[INDEX_CLUSTER_NUMBER]--;
-    write_clusters(&index_table, INDEX_CLUSTER_NUMBER, sizeof(struct IndexTable)/ CLUSTER_SIZE);
-    write_clusters(&driver_state.fat_table, FAT_CLUSTER_NUMBER, 1);
+    kfree(node);
     return 0;
-}
\ No newline at end of file
+}
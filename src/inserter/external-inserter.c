@@ -14,15 +14,22 @@ struct FAT32DriverRequest {
     char      ext[3];
     uint32_t  parent_cluster_number;
     uint32_t  buffer_size;
+    uint32_t  offset;
 } __attribute__((packed));
 
 void*  memcpy(void* restrict dest, const void* restrict src, size_t n);
 
 void   initialize_filesystem_fat32(void);
+int8_t set_format_cluster_size(uint32_t cluster_size);
 int8_t read(struct FAT32DriverRequest request);
 int8_t read_directory(struct FAT32DriverRequest request);
 int8_t write(struct FAT32DriverRequest request);
 int8_t delete(struct FAT32DriverRequest request);
+void   cache_sync(void);
+
+// Kernel heap is backed by host allocator
+void *kmalloc(uint32_t size) { return malloc(size); }
+void  kfree(void *ptr)       { free(ptr); }
 
 
 
@@ -30,6 +37,7 @@ int8_t delete(struct FAT32DriverRequest request);
 // Global variable
 uint8_t *image_storage;
 uint8_t *file_buffer;
+size_t   image_size;
 
 void read_blocks(void *ptr, uint32_t logical_block_address, uint8_t block_count) {
     for (int i = 0; i < block_count; i++)
@@ -41,18 +49,25 @@ void write_blocks(const void *ptr, uint32_t logical_block_address, uint8_t block
         memcpy(image_storage + BLOCK_SIZE*(logical_block_address+i), (uint8_t*) ptr + BLOCK_SIZE*i, BLOCK_SIZE);
 }
 
+uint32_t get_disk_block_count(void) {
+    return image_size / BLOCK_SIZE;
+}
+
 
 int main(int argc, char *argv[]) {
     if (argc < 4) {
-        fprintf(stderr, "inserter: ./inserter <file to insert> <parent cluster index> <storage>\n");
+        fprintf(stderr, "inserter: ./inserter <file to insert> <parent cluster index> <storage> [cluster size]\n");
         exit(1);
     }
 
-    // Read storage into memory, requiring 4 MB memory
-    image_storage     = malloc(4*1024*1024);
-    file_buffer       = malloc(4*1024*1024);
+    // Read whole storage into memory, FAT size follow storage size
     FILE *fptr        = fopen(argv[3], "r");
-    fread(image_storage, 4*1024*1024, 1, fptr);
+    fseek(fptr, 0, SEEK_END);
+    image_size        = ftell(fptr);
+    fseek(fptr, 0, SEEK_SET);
+    image_storage     = malloc(image_size);
+    file_buffer       = malloc(4*1024*1024);
+    fread(image_storage, image_size, 1, fptr);
     fclose(fptr);
 
     // Read target file, assuming file is less than 4 MiB
@@ -70,7 +85,15 @@ int main(int argc, char *argv[]) {
     printf("Filename : %s\n",  argv[1]);
     printf("Filesize : %ld bytes\n", filesize);
 
-    // FAT32 operations
+    // FAT32 operations, cluster size only matter if storage is formatted here
+    if (argc > 4) {
+        uint32_t cluster_size = 0;
+        sscanf(argv[4], "%u", &cluster_size);
+        if (set_format_cluster_size(cluster_size) != 0) {
+            fprintf(stderr, "inserter: cluster size must be power of two between 2048 and 32768\n");
+            exit(1);
+        }
+    }
     initialize_filesystem_fat32();
     struct FAT32DriverRequest request = {
         .buf         = file_buffer,
@@ -89,9 +112,10 @@ int main(int argc, char *argv[]) {
     else
         puts("Error: Unknown error");
 
-    // Write image in memory into original, overwrite them
+    // Flush buffer cache, then write image in memory into original, overwrite them
+    cache_sync();
     fptr              = fopen(argv[3], "w");
-    fwrite(image_storage, 4*1024*1024, 1, fptr);
+    fwrite(image_storage, image_size, 1, fptr);
     fclose(fptr);
 
     return 0;
@@ -4,6 +4,9 @@
 #include "../lib-header/framebuffer.h"
 #include "../lib-header/fat32.h"
 #include "../lib-header/stdmem.h"
+#include "../lib-header/disk.h"
+#include "../lib-header/cache.h"
+#include "../lib-header/paging.h"
 
 
 
@@ -57,6 +60,40 @@ void pic_remap(void) {
 
 void syscall(struct CPURegister cpu, __attribute__((unused)) struct InterruptStack info) {
     struct FAT32DriverRequest request = *(struct FAT32DriverRequest*) cpu.ebx;
+    switch (cpu.eax) {
+        case (0) : case (1) : case (2) : case (17) : case (18) :
+            // Fault in user buffer before filesystem operation start
+            populate_user_range(request.buf, request.buffer_size);
+            break;
+        case (6) :
+            populate_user_range((void*) cpu.ebx, DIR_PATH_MAX_LENGTH);
+            break;
+        case (8) :
+            populate_user_range((void*) cpu.ebx, DIR_LISTING_BUFFER_SIZE);
+            break;
+        case (12) :
+            populate_user_range(request.buf, request.buffer_size);
+            break;
+        case (14) :
+            populate_user_string((char*) cpu.ebx);
+            populate_user_range((void*) cpu.ecx, *((uint32_t*) cpu.edx) * sizeof(struct IndexEntry));
+            break;
+        case (15) :
+            populate_user_string((char*) cpu.ebx);
+            break;
+        case (16) :
+            populate_user_range(((struct DirPathBatchRequest*) cpu.ebx)->clusters,
+                ((struct DirPathBatchRequest*) cpu.ebx)->count * sizeof(uint32_t));
+            populate_user_range(((struct DirPathBatchRequest*) cpu.ebx)->buf, ((struct DirPathBatchRequest*) cpu.ebx)->buffer_size);
+            break;
+        case (19) :
+            populate_user_range((void*) cpu.edx, sizeof(struct FAT32FileStat));
+            break;
+        case (22) : case (23) :
+            populate_user_range(((struct FileIORequest*) cpu.ebx)->buf, ((struct FileIORequest*) cpu.ebx)->size);
+            break;
+    }
+
     switch (cpu.eax) {
         case (0) :
             *((int8_t*) cpu.ecx) = read(request);
@@ -66,11 +103,16 @@ void syscall(struct CPURegister cpu, __attribute__((unused)) struct InterruptSta
             break;
         case (2) :
             *((int8_t*) cpu.ecx) = write(request);
+            cache_commit(FALSE);
             break;
         case (3) :
             *((int8_t*) cpu.ecx) = delete(request);
+            cache_commit(FALSE);
             break;
         case (4) : 
+            // Waiting for user input, commit grouped operation now & scrub some freed cluster
+            cache_commit(TRUE);
+            scrub_free_clusters(SCRUB_IDLE_CLUSTER_COUNT);
             keyboard_state_activate();
             __asm__("sti"); 
             while (is_keyboard_blocking());
@@ -90,7 +132,8 @@ void syscall(struct CPURegister cpu, __attribute__((unused)) struct InterruptSta
             show_file((char* ) cpu.ebx, cpu.ecx);
             break;
         case (8) :
-            get_children((char* ) cpu.ebx, cpu.ecx);
+            // ebx buffer of at least DIR_LISTING_BUFFER_SIZE byte, ecx directory, edx pointer to listing cursor
+            get_children((char* ) cpu.ebx, DIR_LISTING_BUFFER_SIZE, cpu.ecx, (uint32_t*) cpu.edx);
             break;
         case (9) :
             *((uint32_t*) cpu.ecx) = move_to_child_directory(request);
@@ -102,9 +145,85 @@ void syscall(struct CPURegister cpu, __attribute__((unused)) struct InterruptSta
             framebuffer_clear();
             break;
         case (12) :
-            uint32_t found_count = search_index((uint32_t *) request.buf, request.name, request.ext);
+            uint32_t found_count = search_index((uint32_t *) request.buf, request.buffer_size / sizeof(uint32_t), request.name, request.ext);
             *((uint32_t*) cpu.ecx) = found_count;
             break;
+        case (13) :
+            cache_sync();
+            break;
+        case (14) :
+            // ebx pattern, ecx struct IndexEntry buffer, edx pointer to buffer capacity & found count
+            *((uint32_t*) cpu.edx) = search_index_pattern((struct IndexEntry*) cpu.ecx, *((uint32_t*) cpu.edx), (char*) cpu.ebx);
+            break;
+        case (15) :
+            // ebx path, ecx start directory, edx pointer to resolved directory (0 if not found)
+            *((uint32_t*) cpu.edx) = resolve_path((char*) cpu.ebx, cpu.ecx);
+            break;
+        case (16) :
+            // ebx pointer to struct DirPathBatchRequest, ecx pointer to resolved count
+            *((uint32_t*) cpu.ecx) = get_dir_path_batch(*(struct DirPathBatchRequest*) cpu.ebx);
+            break;
+        case (17) :
+            // edx pointer to transferred byte count
+            *((int8_t*) cpu.ecx) = read_range(request, (uint32_t*) cpu.edx);
+            break;
+        case (18) :
+            *((int8_t*) cpu.ecx) = write_range(request);
+            cache_commit(FALSE);
+            break;
+        case (19) :
+            // edx pointer to struct FAT32FileStat
+            *((int8_t*) cpu.ecx) = stat_file(request, (struct FAT32FileStat*) cpu.edx);
+            break;
+        case (20) :
+            *((int8_t*) cpu.ecx) = truncate_file(request);
+            cache_commit(FALSE);
+            break;
+        case (21) :
+            // edx pointer to opened handle number
+            *((int8_t*) cpu.ecx) = open_file(request, (int32_t*) cpu.edx);
+            break;
+        case (22) : {
+            // ebx pointer to struct FileIORequest for handle syscall, edx pointer to transferred byte count
+            struct FileIORequest io = *(struct FileIORequest*) cpu.ebx;
+            *((int8_t*) cpu.ecx) = read_file(io.fd, io.buf, io.size, (uint32_t*) cpu.edx);
+            break;
+        }
+        case (23) : {
+            struct FileIORequest io = *(struct FileIORequest*) cpu.ebx;
+            *((int8_t*) cpu.ecx) = write_file(io.fd, io.buf, io.size);
+            cache_commit(FALSE);
+            break;
+        }
+        case (24) : {
+            // edx pointer to new position
+            struct FileIORequest io = *(struct FileIORequest*) cpu.ebx;
+            *((int8_t*) cpu.ecx) = seek_file(io.fd, io.offset, io.whence, (uint32_t*) cpu.edx);
+            break;
+        }
+        case (25) :
+            *((int8_t*) cpu.ecx) = close_file(((struct FileIORequest*) cpu.ebx)->fd);
+            break;
+        case (26) :
+            // ebx source request, ecx dest request, edx pointer to return code
+            *((int8_t*) cpu.edx) = rename_entry(request, *(struct FAT32DriverRequest*) cpu.ecx);
+            cache_commit(FALSE);
+            break;
+        case (27) :
+            // Same argument as rename, dest share source cluster
+            *((int8_t*) cpu.edx) = copy_entry(request, *(struct FAT32DriverRequest*) cpu.ecx, FALSE);
+            cache_commit(FALSE);
+            break;
+        case (28) :
+            // Same argument as rename, every data cluster is duplicated
+            *((int8_t*) cpu.edx) = copy_entry(request, *(struct FAT32DriverRequest*) cpu.ecx, TRUE);
+            cache_commit(FALSE);
+            break;
+        case (29) :
+            // ecx ZERO_POLICY_*, edx pointer to return code
+            *((int8_t*) cpu.edx) = set_zero_policy(cpu.ecx);
+            cache_commit(FALSE);
+            break;
     }
 }
 
@@ -117,15 +236,31 @@ void main_interrupt_handler(
         case (PIC1 + IRQ_KEYBOARD):
             keyboard_isr();
             break;
+        case (PIC1_OFFSET + IRQ_PRIMARY_ATA):
+            ata_isr();
+            break;
+        case 0xE:
+            page_fault_handler(info);
+            break;
         case 0x30:
             syscall(cpu, info);
             break;
     }
 }
 
+void page_fault_handler(struct InterruptStack info) {
+    uint32_t fault_addr;
+    __asm__ volatile ("mov %%cr2, %0" : "=r"(fault_addr) : /* <Empty> */);
+    if (!handle_page_fault((void*) fault_addr, info.error_code)) {
+        puts("\nUnhandled page fault\n", 22, 0b1100);
+        while (TRUE)
+            __asm__ volatile ("cli; hlt");
+    }
+}
+
 void activate_keyboard_interrupt(void) {
-    out(PIC1_DATA, PIC_DISABLE_ALL_MASK ^ (1 << IRQ_KEYBOARD));
-    out(PIC2_DATA, PIC_DISABLE_ALL_MASK);
+    out(PIC1_DATA, PIC_DISABLE_ALL_MASK ^ (1 << IRQ_KEYBOARD) ^ (1 << IRQ_CASCADE));
+    out(PIC2_DATA, PIC_DISABLE_ALL_MASK ^ (1 << (IRQ_PRIMARY_ATA - 8)));
 }
 
 void set_tss_kernel_current_stack(void) {
@@ -13,36 +13,56 @@
 
 /*======================= MILESTONE 3 ============================*/
 
-void kernel_setup(void) {
+void kernel_setup(struct MultibootInfo *multiboot_info) {
     enter_protected_mode(&_gdt_gdtr);
+    initialize_page_frame_allocator(multiboot_info);
     pic_remap();
     initialize_idt();
     activate_keyboard_interrupt();
     framebuffer_clear();
     framebuffer_set_cursor(0, 0);
+    initialize_disk();
     initialize_filesystem_fat32();
     gdt_install_tss();
     set_tss_register();
 
-    // Allocate first 4 MiB virtual memory
-    allocate_single_user_page_frame((uint8_t*) 0);
+    // Shell run in its own address space, kernel half is shared
+    uint32_t shell_directory;
+    create_page_directory(&shell_directory);
+    switch_page_directory(shell_directory);
 
-    // Write shell into memory
+    // Shell image & stack is demand paged, page is populated on first access
     struct FAT32DriverRequest request = {
-        .buf                   = (uint8_t*) 0,
         .name                  = "shell",
         .ext                   = "\0\0\0",
         .parent_cluster_number = ROOT_CLUSTER_NUMBER,
-        .buffer_size           = 0x100000,
     };
-    read(request);
+    struct FAT32FileStat shell_stat;
+    if (stat_file(request, &shell_stat) != 0)
+        shell_stat.filesize = 0;
+
+    struct UserPageRegion image_region = {
+        .virtual_addr          = 0,
+        .size                  = USER_PROGRAM_MAX_SIZE,
+        .file_size             = shell_stat.filesize,
+        .name                  = "shell",
+        .ext                   = "\0\0\0",
+        .parent_cluster_number = ROOT_CLUSTER_NUMBER,
+    };
+    struct UserPageRegion stack_region = {
+        .virtual_addr          = USER_STACK_TOP - USER_STACK_SIZE,
+        .size                  = USER_STACK_SIZE,
+    };
+    add_user_page_region(image_region);
+    add_user_page_region(stack_region);
     
+    char lorem[] = "Lorem ipsum dolor sit amet, consectetur adipiscing elit, \n";
     struct FAT32DriverRequest request2 = {
-        .buf                   = (uint8_t*) "Lorem ipsum dolor sit amet, consectetur adipiscing elit, \n",
+        .buf                   = (uint8_t*) lorem,
         .name                  = "lorem",
         .ext                   = "txt",
         .parent_cluster_number = ROOT_CLUSTER_NUMBER,
-        .buffer_size           = 1*CLUSTER_SIZE,
+        .buffer_size           = sizeof(lorem) - 1,
     };
     write(request2);
 
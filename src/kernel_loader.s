@@ -7,8 +7,9 @@ extern _paging_kernel_page_directory          ; kernel page directory
 KERNEL_VIRTUAL_BASE equ 0xC0000000            ; kernel virtual memory
 KERNEL_STACK_SIZE   equ 2097152               ; size of stack in bytes
 MAGIC_NUMBER        equ 0x1BADB002            ; define the magic number constant
-FLAGS               equ 0x0                   ; multiboot flags
-CHECKSUM            equ -MAGIC_NUMBER         ; calculate the checksum
+BOOTLOADER_MAGIC    equ 0x2BADB002            ; eax value set by multiboot loader, ebx hold info pointer
+FLAGS               equ 0x2                   ; multiboot flags, request memory information
+CHECKSUM            equ -(MAGIC_NUMBER + FLAGS) ; calculate the checksum
                                               ; (magic number + checksum + flags should equal 0)
 
 
@@ -29,13 +30,20 @@ align 4                                       ; the code must be 4 byte aligned
 section .setup.text                           ; start of the text (code) section
 loader equ (loader_entrypoint - KERNEL_VIRTUAL_BASE)
 loader_entrypoint:                            ; the loader label (defined as entry point in linker script)
+    ; Keep multiboot information physical address in ebx, 0 if not loaded by multiboot loader
+    cmp eax, BOOTLOADER_MAGIC
+    je  .multiboot_valid
+    xor ebx, ebx
+.multiboot_valid:
+
     ; Set CR3 (CPU page register)
     mov eax, _paging_kernel_page_directory - KERNEL_VIRTUAL_BASE
     mov cr3, eax
 
-    ; Use 4 MB paging
+    ; Use 4 MB paging & global page
     mov eax, cr4
     or  eax, 0x00000010    ; PSE (4 MB paging)
+    or  eax, 0x00000080    ; PGE (global kernel mapping is kept in TLB on CR3 switch)
     mov cr4, eax
 
     ; Enable paging
@@ -51,6 +59,11 @@ loader_virtual:
     mov dword [_paging_kernel_page_directory], 0
     invlpg [0] ; Delete identity mapping and invalidate TLB cache for first page
     mov esp, kernel_stack + KERNEL_STACK_SIZE ; Setup stack register to proper location
+    test ebx, ebx
+    jz  .call_kernel
+    add ebx, KERNEL_VIRTUAL_BASE              ; Multiboot information is in first 4 MiB, use higher half address
+.call_kernel:
+    push ebx                                  ; kernel_setup(struct MultibootInfo *multiboot_info)
     call kernel_setup
 .loop:
     jmp .loop                                 ; loop forever
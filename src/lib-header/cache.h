@@ -0,0 +1,187 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include "disk.h"
+#include "stdtype.h"
+
+/**
+ * Buffer cache - LRU write-back cache between file system and ATA driver.
+ * Cached unit is a line of CACHE_LINE_BLOCK_COUNT blocks, keyed by LBA of first block in line.
+ * Transfer within single line is write-back. Transfer spanning multiple lines is issued to disk
+ * as single command (write-through), and if larger than CACHE_BYPASS_LINE_COUNT lines will not
+ * populate the cache. Both still stay coherent with resident lines.
+ */
+
+#define CACHE_LINE_BLOCK_COUNT  4
+#define CACHE_LINE_SIZE         (BLOCK_SIZE*CACHE_LINE_BLOCK_COUNT)
+#define CACHE_LINE_COUNT        64
+#define CACHE_HASH_BUCKET_COUNT 64
+#define CACHE_BYPASS_LINE_COUNT 4
+#define CACHE_NO_LINE           -1
+
+/**
+ * Metadata journal - dirty lines are committed as one sequential write into a journal slot,
+ * then written into their home location lazily (checkpoint). Two slots are used alternately
+ * so a torn commit never damage the last committed one. Every commit log all dirty lines,
+ * so newest slot alone is enough to replay
+ */
+#define JOURNAL_MAGIC                   0x4C4E524A
+#define JOURNAL_LINE_COUNT              CACHE_LINE_COUNT
+#define JOURNAL_SLOT_BLOCK_COUNT        ((1 + JOURNAL_LINE_COUNT)*CACHE_LINE_BLOCK_COUNT)
+#define JOURNAL_BLOCK_COUNT             (2*JOURNAL_SLOT_BLOCK_COUNT)
+#define JOURNAL_GROUP_OP_COUNT          8
+#define JOURNAL_CHECKPOINT_LINE_COUNT   (CACHE_LINE_COUNT / 2)
+
+/**
+ * CacheLine - One cached line of blocks
+ *
+ * @param lba         LBA of first block in this line, multiple of CACHE_LINE_BLOCK_COUNT
+ * @param valid       This line contain data of lba
+ * @param dirty       Data in buf is newer than disk, need writeback before eviction
+ * @param logged      Dirty data is committed in journal, can be written home without commit
+ * @param hash_next   Next line index in same hash bucket
+ * @param lru_prev    Line index that used more recently than this line
+ * @param lru_next    Line index that used less recently than this line
+ * @param buf         Cached data
+ */
+struct CacheLine {
+    uint32_t lba;
+    bool     valid;
+    bool     dirty;
+    bool     logged;
+    int16_t  hash_next;
+    int16_t  lru_prev;
+    int16_t  lru_next;
+    uint8_t  buf[CACHE_LINE_SIZE];
+} __attribute__((packed));
+
+/**
+ * CacheStats - Buffer cache counters since boot
+ *
+ * @param hit       Line lookup served from cache
+ * @param miss      Line lookup that need disk read
+ * @param writeback Dirty line written back into disk
+ * @param eviction  Valid line replaced with other line
+ * @param bypass    Transfer that not populate cache due to size
+ * @param commit    Journal commit
+ * @param replay    Line replayed from journal on attach
+ */
+struct CacheStats {
+    uint32_t hit;
+    uint32_t miss;
+    uint32_t writeback;
+    uint32_t eviction;
+    uint32_t bypass;
+    uint32_t commit;
+    uint32_t replay;
+} __attribute__((packed));
+
+/**
+ * JournalHeader - First block of journal slot, written last in commit
+ *
+ * @param magic      JOURNAL_MAGIC
+ * @param sequence   Commit number, slot with higher sequence is newer
+ * @param line_count Line logged in this slot, 0 if already checkpointed
+ * @param checksum   FNV-1a of every logged line content
+ * @param lba        Home address of every logged line, line i is stored after header at line offset 1 + i
+ */
+struct JournalHeader {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t line_count;
+    uint32_t checksum;
+    uint32_t lba[JOURNAL_LINE_COUNT];
+    uint8_t  padding[BLOCK_SIZE - 16 - 4*JOURNAL_LINE_COUNT];
+} __attribute__((packed));
+
+/**
+ * BufferCacheState - Contain all buffer cache states
+ *
+ * @param line        Cache line storage
+ * @param hash_bucket First line index for every hash bucket, CACHE_NO_LINE if empty
+ * @param lru_head    Most recently used line index
+ * @param lru_tail    Least recently used line index, will be evicted first
+ * @param stats       Cache counters
+ */
+struct BufferCacheState {
+    struct CacheLine  line[CACHE_LINE_COUNT];
+    int16_t           hash_bucket[CACHE_HASH_BUCKET_COUNT];
+    int16_t           lru_head;
+    int16_t           lru_tail;
+    struct CacheStats stats;
+} __attribute__((packed));
+
+
+
+
+
+/**
+ * Read blocks through buffer cache, same semantic with read_blocks()
+ *
+ * @param ptr                   Pointer for storing reading data
+ * @param logical_block_address Block address to read data from
+ * @param block_count           How many block to read
+ */
+void cache_read_blocks(void *ptr, uint32_t logical_block_address, uint32_t block_count);
+
+/**
+ * Write blocks into buffer cache, same semantic with write_blocks().
+ * Single line write only reach disk on eviction or cache_sync()
+ *
+ * @param ptr                   Pointer to data that to be written
+ * @param logical_block_address Block address to write data into
+ * @param block_count           How many block to write
+ */
+void cache_write_blocks(const void *ptr, uint32_t logical_block_address, uint32_t block_count);
+
+/**
+ * Access single block directly inside cache line, avoid copying for small read-modify-write
+ * such as FAT entry. Returned pointer only valid until next buffer cache call
+ *
+ * @param logical_block_address Block address to access
+ * @param will_modify           Mark line as dirty, caller will modify block content
+ * @return                      Pointer to BLOCK_SIZE bytes of block content
+ */
+uint8_t* cache_get_block(uint32_t logical_block_address, bool will_modify);
+
+/**
+ * Discard hint, every cached line fully inside range is dropped without writeback.
+ * Used when content of range is no longer needed (freed cluster)
+ *
+ * @param logical_block_address First block of range
+ * @param block_count           Block count
+ */
+void cache_discard_blocks(uint32_t logical_block_address, uint32_t block_count);
+
+/**
+ * Fill range with zero directly on disk, cached lines inside range are discarded first
+ * so scrubbing never pollute cache nor journal
+ *
+ * @param logical_block_address First block of range, multiple of CACHE_LINE_BLOCK_COUNT
+ * @param block_count           Block count, multiple of CACHE_LINE_BLOCK_COUNT
+ */
+void cache_zero_blocks(uint32_t logical_block_address, uint32_t block_count);
+
+/**
+ * Enable metadata journal located at lba (JOURNAL_BLOCK_COUNT blocks), newest committed
+ * slot is replayed into home location first. Every cached line is dropped afterward
+ *
+ * @param logical_block_address First block of journal, multiple of CACHE_LINE_BLOCK_COUNT
+ */
+void cache_journal_attach(uint32_t logical_block_address);
+
+/**
+ * End of one metadata operation. Without journal every dirty line is written back now,
+ * with journal operations are grouped & committed every JOURNAL_GROUP_OP_COUNT call
+ *
+ * @param force Commit now instead of waiting for group to fill
+ */
+void cache_commit(bool force);
+
+// Write back all dirty lines into disk, journal is committed & checkpointed first
+void cache_sync(void);
+
+// Get buffer cache counters - @return Copy of counters
+struct CacheStats cache_get_stats(void);
+
+#endif
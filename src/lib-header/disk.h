@@ -13,6 +13,45 @@
 #define BLOCK_SIZE      512
 #define HALF_BLOCK_SIZE (BLOCK_SIZE/2)
 
+/* -- ATA command set -- */
+#define ATA_CMD_READ_PIO   0x20
+#define ATA_CMD_WRITE_PIO  0x30
+#define ATA_CMD_READ_DMA   0xC8
+#define ATA_CMD_WRITE_DMA  0xCA
+#define ATA_CMD_IDENTIFY   0xEC
+
+/* -- ATA device control register (primary channel), SRST reset drive -- */
+#define ATA_CONTROL_PORT   0x3F6
+#define ATA_CONTROL_SRST   0x04
+
+/* -- PCI configuration space, used for locating IDE bus-master controller -- */
+#define PCI_CONFIG_ADDRESS      0xCF8
+#define PCI_CONFIG_DATA         0xCFC
+#define PCI_CLASS_MASS_STORAGE  0x01
+#define PCI_SUBCLASS_IDE        0x01
+#define PCI_COMMAND_IO_SPACE    0x0001
+#define PCI_COMMAND_BUS_MASTER  0x0004
+
+/* -- IDE bus-master registers (offset from BAR4), primary channel only -- */
+#define BM_REG_COMMAND          0x00
+#define BM_REG_STATUS           0x02
+#define BM_REG_PRDT             0x04
+#define BM_COMMAND_START        0x01
+#define BM_COMMAND_READ         0x08
+#define BM_STATUS_ERROR         0x02
+#define BM_STATUS_INTERRUPT     0x04
+
+#define PRD_END_OF_TABLE        0x8000
+#define ATA_DMA_PRD_COUNT       2
+#define ATA_DMA_BOUNDARY        0x10000
+#define ATA_DMA_BUFFER_SIZE     (2*ATA_DMA_BOUNDARY)
+
+#define BLOCK_REQUEST_SUCCESS   0
+#define BLOCK_REQUEST_ERROR    -1
+
+// Polling iteration before in-flight request is considered lost, DMA request is retried with PIO
+#define ATA_REQUEST_TIMEOUT     10000000
+
 
 
 
@@ -22,13 +61,70 @@ struct BlockBuffer {
     uint8_t buf[BLOCK_SIZE];
 } __attribute__((packed));
 
+/**
+ * PhysicalRegionDescriptor, one entry of bus-master PRD table.
+ * Region must be physically contiguous and must not cross 64 KiB boundary.
+ *
+ * @param physical_addr Physical address of memory region
+ * @param byte_count    Region size in byte, 0 mean 64 KiB
+ * @param flag          PRD_END_OF_TABLE for last entry of the table
+ */
+struct PhysicalRegionDescriptor {
+    uint32_t physical_addr;
+    uint16_t byte_count;
+    uint16_t flag;
+} __attribute__((packed));
+
+/**
+ * BlockRequest - Asynchronous block I/O request, queued with submit_block_request().
+ * Request memory must stay valid until done is set.
+ *
+ * @param buf                   Pointer to source / destination buffer
+ * @param logical_block_address Starting block address, LBA addressing
+ * @param block_count           How many block to transfer
+ * @param is_write              Transfer direction, TRUE for write into disk
+ * @param done                  Set by ata_isr() when request is completed
+ * @param status                BLOCK_REQUEST_SUCCESS or BLOCK_REQUEST_ERROR, valid after done
+ * @param callback              Optional, called from ata_isr() on completion (interrupt context)
+ * @param next                  Used internally for request queue
+ */
+struct BlockRequest {
+    void                *buf;
+    uint32_t             logical_block_address;
+    uint8_t              block_count;
+    bool                 is_write;
+    volatile bool        done;
+    int8_t               status;
+    void               (*callback)(struct BlockRequest *request);
+    struct BlockRequest *next;
+} __attribute__((packed));
+
+/**
+ * ATADriverState - Contain all driver states
+ *
+ * @param dma_enabled     Bus-master DMA controller found and usable, else fallback to PIO
+ * @param bus_master_base I/O port base of primary channel bus-master registers (BAR4)
+ * @param queue_head      Request currently in-flight on disk, 0 if disk idle
+ * @param queue_tail      Last submitted request
+ * @param pio_block_index Next block index to transfer for in-flight PIO request
+ * @param block_count     Addressable LBA28 block count reported by ATA IDENTIFY, 0 if unknown
+ */
+struct ATADriverState {
+    bool                         dma_enabled;
+    uint16_t                     bus_master_base;
+    struct BlockRequest *volatile queue_head;
+    struct BlockRequest         *queue_tail;
+    uint8_t                      pio_block_index;
+    uint32_t                     block_count;
+} __attribute__((packed));
+
 
 
 
 
 /**
- * ATA PIO logical block address read blocks. Will blocking until read is completed.
- * Note: ATA PIO will use 2-bytes per read/write operation.
+ * ATA logical block address read blocks. Will blocking until read is completed.
+ * Note: Synchronous wrapper for submit_block_request(), use DMA if available, else PIO.
  * Recommended to use struct BlockBuffer
  * 
  * @param ptr                   Pointer for storing reading data, this pointer should point to already allocated memory location.
@@ -39,8 +135,8 @@ struct BlockBuffer {
 void read_blocks(void *ptr, uint32_t logical_block_address, uint8_t block_count);
 
 /**
- * ATA PIO logical block address write blocks. Will blocking until write is completed.
- * Note: ATA PIO will use 2-bytes per read/write operation.
+ * ATA logical block address write blocks. Will blocking until write is completed.
+ * Note: Synchronous wrapper for submit_block_request(), use DMA if available, else PIO.
  * Recommended to use struct BlockBuffer
  *
  * @param ptr                   Pointer to data that to be written into disk. Memory pointed should be positive integer multiple of BLOCK_SIZE
@@ -49,4 +145,41 @@ void read_blocks(void *ptr, uint32_t logical_block_address, uint8_t block_count)
  */
 void write_blocks(const void *ptr, uint32_t logical_block_address, uint8_t block_count);
 
+/**
+ * Queue block request into disk request queue and return immediately.
+ * Request will be started once all previous request completed, completion raised by IRQ14.
+ *
+ * @param request Request to submit, done and status will be updated by ata_isr()
+ */
+void submit_block_request(struct BlockRequest *request);
+
+/**
+ * Wait until request is done. Interrupt will be enabled while waiting.
+ * If in-flight request does not complete within ATA_REQUEST_TIMEOUT, drive is reset,
+ * DMA request is retried with PIO (DMA disabled), and PIO request fail with BLOCK_REQUEST_ERROR
+ *
+ * @param request Already submitted request
+ */
+void wait_block_request(struct BlockRequest *request);
+
+/**
+ * Identify primary master disk capacity, then scan PCI bus for IDE controller
+ * with bus-master capability and enable DMA transfer.
+ * If no controller found, read_blocks() and write_blocks() will keep using ATA PIO
+ */
+void initialize_disk(void);
+
+/**
+ * Get disk capacity, queried with ATA IDENTIFY during initialize_disk()
+ *
+ * @return Total addressable block count, 0 if disk does not respond to IDENTIFY
+ */
+uint32_t get_disk_block_count(void);
+
+/**
+ * Primary ATA interrupt service routine (IRQ14).
+ * Continue or complete in-flight request, then start next request in queue
+ */
+void ata_isr(void);
+
 #endif
\ No newline at end of file
@@ -15,10 +15,32 @@
 
 /* -- IF2230 File System constants -- */
 #define BOOT_SECTOR           0
-#define CLUSTER_BLOCK_COUNT   4
+#define FSINFO_SECTOR         1
+#define FAT_ENTRY_PER_BLOCK   (BLOCK_SIZE / sizeof(uint32_t))
+
+// Cluster size is chosen per volume on create_fat32() (power of two, 2 KiB - 32 KiB) and recorded in FSInfo
+#define CLUSTER_MIN_BLOCK_COUNT     4
+#define CLUSTER_MAX_BLOCK_COUNT     64
+#define CLUSTER_DEFAULT_BLOCK_COUNT 4
+#define CLUSTER_MAX_SIZE            (BLOCK_SIZE*CLUSTER_MAX_BLOCK_COUNT)
+
+// Cluster geometry of mounted volume, only valid after initialize_filesystem_fat32()
+#define CLUSTER_BLOCK_COUNT   (driver_state.cluster_block_count)
 #define CLUSTER_SIZE          (BLOCK_SIZE*CLUSTER_BLOCK_COUNT)
+#define FAT_ENTRY_PER_CLUSTER (CLUSTER_SIZE / sizeof(uint32_t))
+
+// FAT page entry count of default cluster size, volume without geometry use 1 FAT page with CLUSTER_MAP_SIZE clusters
 #define CLUSTER_MAP_SIZE      512
 
+// Buffer size of get_children() listing syscall
+#define DIR_LISTING_BUFFER_SIZE 2048
+
+// Largest volume supported by driver, FAT span multiple cluster (FAT page) after first one
+#define FAT32_MAX_CLUSTER_COUNT (1 << 18)
+
+// Longest cluster run in single read_clusters / write_clusters, limited by block_count 255
+#define CLUSTER_RUN_MAX_COUNT (255 / CLUSTER_BLOCK_COUNT)
+
 /* -- FAT32 FileAllocationTable constants -- */
 // FAT reserved value for cluster 0 and 1 in FileAllocationTable
 #define CLUSTER_0_VALUE       0x0FFFFFF0
@@ -31,10 +53,25 @@
 #define FAT_CLUSTER_NUMBER    1
 #define ROOT_CLUSTER_NUMBER   2
 #define INDEX_CLUSTER_NUMBER  3
+#define FIRST_DATA_CLUSTER_NUMBER 8
 
 /* -- FAT32 DirectoryEntry constants -- */
 #define ATTR_SUBDIRECTORY     0b00010000
 #define UATTR_NOT_EMPTY       0b10101010
+// File entry filesize is exact byte size, entry without it (legacy) span whole cluster chain
+#define UATTR_FILESIZE_EXACT  0b00000001
+// File data is packed inside shared tail cluster at byte offset access_date, cluster field point to tail cluster
+#define UATTR_TAIL_PACKED     0b00000100
+
+/* -- Tail packing constants -- */
+// Tail cluster is split into TAIL_UNIT_COUNT unit, unit 0 hold struct TailClusterHeader
+#define TAIL_UNIT_COUNT       32
+#define TAIL_UNIT_SIZE        (CLUSTER_SIZE / TAIL_UNIT_COUNT)
+// File with size up to TAIL_MAX_SIZE (but not empty) is packed on write
+#define TAIL_MAX_SIZE         (CLUSTER_SIZE / 2)
+#define TAIL_MAGIC            0x4C494154
+// Partially used tail cluster remembered for reuse after delete
+#define TAIL_CANDIDATE_COUNT  8
 
 #define RD_REQUEST_SUCCESS_RETURN       0
 #define RD_REQUEST_NOT_A_FOLDER_RETURN  1
@@ -50,6 +87,8 @@
 #define W_REQUEST_SUCCESS_RETURN            0
 #define W_REQUEST_FILE_ALREADY_EXIST_RETURN 1
 #define W_REQUEST_INVALID_PARENT_RETURN     2
+#define W_REQUEST_NOT_A_FILE_RETURN         3
+#define W_REQUEST_NOT_FOUND_RETURN          4
 #define W_REQUEST_UNKNOWN_RETURN           -1
 
 #define D_REQUEST_SUCCESS_RETURN            0
@@ -57,31 +96,197 @@
 #define D_FOLDER_NOT_EMPTY_RETURN           2
 #define D_REQUEST_UNKNOWN_RETURN           -1
 
+#define MV_REQUEST_SUCCESS_RETURN           0
+#define MV_REQUEST_NOT_FOUND_RETURN         1
+#define MV_REQUEST_ALREADY_EXIST_RETURN     2
+#define MV_REQUEST_INVALID_PARENT_RETURN    3
+#define MV_REQUEST_INTO_ITSELF_RETURN       4
+#define MV_REQUEST_UNKNOWN_RETURN          -1
+
+#define CP_REQUEST_SUCCESS_RETURN           0
+#define CP_REQUEST_NOT_FOUND_RETURN         1
+#define CP_REQUEST_ALREADY_EXIST_RETURN     2
+#define CP_REQUEST_INVALID_PARENT_RETURN    3
+#define CP_REQUEST_INTO_ITSELF_RETURN       4
+#define CP_REQUEST_UNKNOWN_RETURN          -1
+
+// Cluster shared by more than REFCOUNT_MAX + 1 file is not shared further, copy fall back to full copy
+#define REFCOUNT_MAX          0xFF
+
+/* -- Freed cluster zeroing policy, stored per volume in FSInfo -- */
+// Freed cluster is zero filled immediately on delete
+#define ZERO_POLICY_EAGER       0
+// Freed cluster is discarded from cache & zero filled later by scrub_free_clusters()
+#define ZERO_POLICY_LAZY        1
+// Pending cluster scrubbed every time kernel wait for keyboard input
+#define SCRUB_IDLE_CLUSTER_COUNT 16
+
+/* -- FSInfo constants, following FAT32 FSInfo sector layout -- */
+#define FSINFO_LEAD_SIGNATURE   0x41615252
+#define FSINFO_STRUCT_SIGNATURE 0x61417272
+#define FSINFO_TRAIL_SIGNATURE  0xAA550000
+#define FSINFO_UNKNOWN          0xFFFFFFFF
+
 // Boot sector signature for this file system "FAT32 - IF2230 edition"
 extern const uint8_t fs_signature[BLOCK_SIZE];
 
-// Cluster buffer data type - @param buf Byte buffer with size of CLUSTER_SIZE
+// Cluster buffer data type - @param buf Byte buffer large enough for any cluster size, CLUSTER_MAX_SIZE
 struct ClusterBuffer {
-    uint8_t buf[CLUSTER_SIZE];
+    uint8_t buf[CLUSTER_MAX_SIZE];
 } __attribute__((packed));
 
+/**
+ * Name index entry, also B+tree key. Key ordered by name, ext, then parent_cluster_number
+ *
+ * @param name                  Entry name
+ * @param ext                   Entry extension
+ * @param parent_cluster_number Directory containing this entry
+ */
 struct IndexEntry {
     char name[8];
     char ext[3];
     uint32_t parent_cluster_number;
 } __attribute__((packed));
 
+// Legacy flat index, entry count stored in FAT entry of INDEX_CLUSTER_NUMBER. Only read for migration
+#define INDEX_LEGACY_CLUSTER_COUNT 3
 struct IndexTable {
     struct IndexEntry buf[CLUSTER_MAP_SIZE];
 } __attribute__((packed));
 
+/* -- Dentry cache -- */
+#define DENTRY_CACHE_SIZE 256
+
+/**
+ * Cached result of name lookup inside directory, direct mapped by hash of (parent, name, ext).
+ * Negative entry remember that name does not exist in directory
+ *
+ * @param parent_cluster_number Searched directory, 0 if slot is unused
+ * @param name                  Looked up name
+ * @param ext                   Looked up extension
+ * @param negative              TRUE if name does not exist in directory
+ * @param attribute             Attribute of found entry
+ * @param cluster               First cluster of found entry
+ */
+struct DentryCacheEntry {
+    uint32_t parent_cluster_number;
+    char     name[8];
+    char     ext[3];
+    bool     negative;
+    uint8_t  attribute;
+    uint32_t cluster;
+} __attribute__((packed));
+
+/* -- Directory path cache -- */
+#define DIR_PATH_MAX_LENGTH    256
+#define DIR_PATH_CACHE_COUNT   16
+
+/**
+ * Cached full path of directory, built from cached path of its parent
+ *
+ * @param cluster   Directory cluster, 0 if this entry is unused
+ * @param last_used Access tick for LRU replacement
+ * @param length    Path length without null terminator
+ * @param path      Null terminated full path, "root/..."
+ */
+struct DirPathCacheEntry {
+    uint32_t cluster;
+    uint32_t last_used;
+    uint32_t length;
+    char     path[DIR_PATH_MAX_LENGTH];
+} __attribute__((packed));
+
+/**
+ * Batch request for get_dir_path_batch()
+ *
+ * @param clusters    Directory cluster to resolve
+ * @param count       Number of cluster
+ * @param buf         Output, null terminated paths placed back to back in clusters order
+ * @param buffer_size Size of buf in byte
+ */
+struct DirPathBatchRequest {
+    uint32_t *clusters;
+    uint32_t  count;
+    char     *buf;
+    uint32_t  buffer_size;
+} __attribute__((packed));
+
+/* -- Name index B+tree -- */
+#define INDEX_NODE_MAX_KEY 105
+#define INDEX_MAX_HEIGHT   8
+#define INDEX_NODE_SIZE    2048
+
+/**
+ * Name index B+tree node, stored at start of its own cluster. Tree root location is stored in FSInfo.
+ * Leaf key is index entry itself, leaf is chained with next_leaf for range scan.
+ * Internal node child[i] hold key less than key[i], child[i+1] hold key greater or equal key[i].
+ * Deleted key is removed from its leaf only, node never merged.
+ * key & child has one extra slot to hold overflow before split
+ *
+ * @param is_leaf   Nonzero if this node is leaf
+ * @param key_count Number of used key
+ * @param next_leaf Next leaf cluster in key order, 0 if this is last leaf
+ * @param key       Sorted key
+ * @param child     Child node cluster, internal node only
+ */
+struct IndexNode {
+    uint16_t          is_leaf;
+    uint16_t          key_count;
+    uint32_t          next_leaf;
+    struct IndexEntry key[INDEX_NODE_MAX_KEY + 1];
+    uint32_t          child[INDEX_NODE_MAX_KEY + 2];
+    uint8_t           padding[INDEX_NODE_SIZE - 8 - (INDEX_NODE_MAX_KEY + 1)*sizeof(struct IndexEntry)
+                                - (INDEX_NODE_MAX_KEY + 2)*sizeof(uint32_t)];
+} __attribute__((packed));
+
 
 /* -- FAT32 Data Structures -- */
 
 /**
- * FAT32 FileAllocationTable, for more information about this, check guidebook
+ * FAT32 FSInfo sector, stored in block FSINFO_SECTOR.
+ * Free cluster count & next free cluster is hint only, driver rebuild exact value from FAT
+ * during initialize_filesystem_fat32(). Volume geometry is stored in reserved area,
+ * volume without geometry (cluster_count == 0) use 1 FAT page with CLUSTER_MAP_SIZE clusters
  *
- * @param cluster_map Containing cluster map of FAT32
+ * @param lead_signature        FSINFO_LEAD_SIGNATURE
+ * @param cluster_count         Total cluster on this volume, including reserved cluster
+ * @param fat_cluster_count     FAT size in cluster, FAT page 0 located at FAT_CLUSTER_NUMBER
+ * @param fat_extension_cluster First cluster of contiguous FAT page 1 until fat_cluster_count-1
+ * @param index_root_cluster    Root node of name index B+tree, 0 if volume still use legacy IndexTable
+ * @param refcount_cluster      First cluster of contiguous cluster reference count table, 0 if no cluster was ever shared
+ * @param journal_cluster       First cluster of contiguous metadata journal, 0 if volume has no journal
+ * @param zero_policy           Freed cluster zeroing, ZERO_POLICY_EAGER (0) for volume created before policy exist
+ * @param tail_cluster          Tail cluster where new small file is packed, 0 if none yet
+ * @param cluster_block_count   Block per cluster, 0 for volume created before cluster size is configurable (CLUSTER_DEFAULT_BLOCK_COUNT)
+ * @param struct_signature      FSINFO_STRUCT_SIGNATURE
+ * @param free_cluster_count    Last known free cluster count, FSINFO_UNKNOWN if unknown
+ * @param next_free_cluster     Cluster number where allocator start searching, FSINFO_UNKNOWN if unknown
+ * @param trail_signature       FSINFO_TRAIL_SIGNATURE
+ */
+struct FAT32FSInfo {
+    uint32_t lead_signature;
+    uint32_t cluster_count;
+    uint32_t fat_cluster_count;
+    uint32_t fat_extension_cluster;
+    uint32_t index_root_cluster;
+    uint32_t refcount_cluster;
+    uint32_t journal_cluster;
+    uint32_t zero_policy;
+    uint32_t tail_cluster;
+    uint32_t cluster_block_count;
+    uint8_t  reserved_1[444];
+    uint32_t struct_signature;
+    uint32_t free_cluster_count;
+    uint32_t next_free_cluster;
+    uint8_t  reserved_2[12];
+    uint32_t trail_signature;
+} __attribute__((packed));
+
+/**
+ * FAT32 FileAllocationTable page, for more information about this, check guidebook.
+ * FAT of whole volume span driver_state.fat_cluster_count pages, use get_fat_entry() / set_fat_entry()
+ *
+ * @param cluster_map Containing cluster map of FAT32, FAT_ENTRY_PER_CLUSTER entry per page (CLUSTER_MAP_SIZE with default cluster)
  */
 struct FAT32FileAllocationTable {
     uint32_t cluster_map[CLUSTER_MAP_SIZE];
@@ -125,28 +330,196 @@ struct FAT32DirectoryEntry {
     uint32_t filesize;
 } __attribute__((packed));
 
+/**
+ * TailClusterHeader - First unit of tail cluster, packed file occupy contiguous unit after it
+ *
+ * @param magic       TAIL_MAGIC
+ * @param unit_bitmap Bit set if unit is used, bit 0 (header) always set
+ */
+struct TailClusterHeader {
+    uint32_t magic;
+    uint32_t unit_bitmap;
+} __attribute__((packed));
+
 // FAT32 DirectoryTable, containing directory entry table - @param table Table of DirectoryEntry that span within 1 cluster
 struct FAT32DirectoryTable {
-    struct FAT32DirectoryEntry table[CLUSTER_SIZE / sizeof(struct FAT32DirectoryEntry)];
+    struct FAT32DirectoryEntry table[CLUSTER_MAX_SIZE / sizeof(struct FAT32DirectoryEntry)];
 } __attribute__((packed));
 
+/* -- Directory hash index -- */
+#define DIR_ENTRY_PER_BLOCK     (BLOCK_SIZE / sizeof(struct FAT32DirectoryEntry))
+#define DIR_ENTRY_PER_CLUSTER   (CLUSTER_SIZE / sizeof(struct FAT32DirectoryEntry))
 
+// Directory grow along FAT chain up to DIR_INDEX_MAX_ENTRY entry, DIR_MAX_CLUSTER_COUNT cluster with smallest cluster
+#define DIR_INDEX_MAX_ENTRY     2048
+#define DIR_MAX_CLUSTER_COUNT   (DIR_INDEX_MAX_ENTRY*sizeof(struct FAT32DirectoryEntry) / (BLOCK_SIZE*CLUSTER_MIN_BLOCK_COUNT))
+#define DIR_CLUSTER_LIMIT       (DIR_INDEX_MAX_ENTRY / DIR_ENTRY_PER_CLUSTER)
+#define DIR_INDEX_CACHE_COUNT   8
+#define DIR_INDEX_BUCKET_COUNT  256
+#define DIR_INDEX_NONE          -1
+
+/**
+ * In-memory hash index over 8.3 name of single directory, rebuilt on first access.
+ * Entry number is slot position along directory cluster chain, entry 0 (directory itself) never indexed.
+ * Used entry linked in bucket chain, free entry linked in free list, both through next
+ *
+ * @param dir_cluster First cluster of indexed directory, 0 if this index is unused
+ * @param last_used   Access tick for LRU replacement
+ * @param entry_count Number of entry covered by this index, DIR_ENTRY_PER_CLUSTER per chain cluster
+ * @param free_head   First free entry, DIR_INDEX_NONE if directory is full
+ * @param bucket      First entry of every hash bucket, DIR_INDEX_NONE if empty
+ * @param cluster     Directory cluster chain, entry e located at cluster[e / DIR_ENTRY_PER_CLUSTER]
+ * @param next        Next entry in same bucket chain or free list
+ * @param tag         Name hash of used entry, compared before directory entry
+ */
+struct DirectoryIndex {
+    uint32_t dir_cluster;
+    uint32_t last_used;
+    uint32_t entry_count;
+    int16_t  free_head;
+    int16_t  bucket[DIR_INDEX_BUCKET_COUNT];
+    uint32_t cluster[DIR_MAX_CLUSTER_COUNT];
+    int16_t  next[DIR_INDEX_MAX_ENTRY];
+    uint32_t tag[DIR_INDEX_MAX_ENTRY];
+} __attribute__((packed));
+
+/* -- Open File Handle -- */
+#define FILE_HANDLE_COUNT      16
+#define FILE_EXTENT_MAX_COUNT  64
+#define FILE_SEEK_SET          0
+#define FILE_SEEK_CUR          1
+#define FILE_SEEK_END          2
+
+/**
+ * FileExtent - Physically contiguous run of file cluster chain
+ *
+ * @param file_cluster First cluster index inside file covered by this run
+ * @param disk_cluster Cluster number of first cluster of this run
+ * @param length       Run length in cluster
+ */
+struct FileExtent {
+    uint32_t file_cluster;
+    uint32_t disk_cluster;
+    uint32_t length;
+} __attribute__((packed));
+
+/**
+ * FileHandle - Open file, directory entry is resolved once on open_file().
+ * Cluster chain is held as extent map sorted by file_cluster, so cluster of any
+ * file offset is found with binary search instead of FAT walk. Chain with more run
+ * than FILE_EXTENT_MAX_COUNT is mapped up to mapped_cluster_count, rest is walked on access
+ *
+ * @param used                  Handle is open
+ * @param parent_cluster_number Parent directory of file
+ * @param entry_num             Entry number of file inside parent DirectoryIndex
+ * @param filesize              Exact file size in byte
+ * @param position              Byte offset of next read_file() / write_file()
+ * @param cluster_count         Cluster chain length
+ * @param mapped_cluster_count  Number of leading chain cluster covered by extent map
+ * @param extent_count          Used extent
+ * @param tail_cluster          Tail cluster holding file data if file is tail packed, else 0
+ * @param tail_offset           Byte offset of file data inside tail cluster
+ * @param extent                Extent map
+ */
+struct FileHandle {
+    bool              used;
+    uint32_t          parent_cluster_number;
+    int16_t           entry_num;
+    uint32_t          filesize;
+    uint32_t          position;
+    uint32_t          cluster_count;
+    uint32_t          mapped_cluster_count;
+    uint32_t          extent_count;
+    uint32_t          tail_cluster;
+    uint16_t          tail_offset;
+    struct FileExtent extent[FILE_EXTENT_MAX_COUNT];
+} __attribute__((packed));
+
+/**
+ * FileIORequest - Argument of handle syscall
+ *
+ * @param fd     Handle number returned by open_file()
+ * @param buf    Buffer for read_file() / write_file()
+ * @param size   Byte count for read_file() / write_file()
+ * @param offset Seek offset for seek_file(), relative to whence
+ * @param whence FILE_SEEK_SET, FILE_SEEK_CUR, or FILE_SEEK_END
+ */
+struct FileIORequest {
+    int32_t   fd;
+    void     *buf;
+    uint32_t  size;
+    int32_t   offset;
+    uint8_t   whence;
+} __attribute__((packed));
 
 
 
 /* -- FAT32 Driver -- */
 
 /**
- * FAT32DriverState - Contain all driver states
+ * FAT32DriverState - Contain all driver states.
+ * FAT itself is not held here, FAT pages is paged in lazily through buffer cache
  * 
- * @param fat_table     FAT of the system, will be loaded during initialize_filesystem_fat32()
- * @param dir_table_buf Buffer for directory table 
- * @param cluster_buf   Buffer for cluster
+ * @param cluster_buf           Buffer for cluster
+ * @param cluster_block_count   Block per cluster of volume, see CLUSTER_SIZE
+ * @param cluster_count         Total cluster on volume, loaded from FSInfo
+ * @param fat_cluster_count     FAT size in cluster (page)
+ * @param fat_extension_cluster Location of FAT page 1 onward
+ * @param index_root_cluster    Root node of name index B+tree
+ * @param refcount_cluster      Cluster reference count table, 0 if not allocated yet
+ * @param journal_cluster       Metadata journal, 0 if volume too small for journal
+ * @param zero_policy           Freed cluster zeroing policy of volume
+ * @param tail_cluster          Tail cluster where new small file is packed first
+ * @param tail_candidate        Other tail cluster with freed unit, 0 if slot unused
+ * @param tail_candidate_next   Candidate slot replaced next, round robin
+ * @param free_cluster_bitmap   Bit set if cluster is free, only data cluster (>= FIRST_DATA_CLUSTER_NUMBER) can be set
+ * @param free_cluster_count    Number of bit set in free_cluster_bitmap
+ * @param next_free_cluster     Lowest cluster number that may be free, allocation start searching here
+ * @param scrub_cluster_bitmap  Bit set if free cluster still hold old content, only used with ZERO_POLICY_LAZY
+ * @param scrub_cluster_count   Number of bit set in scrub_cluster_bitmap
+ * @param free_uncommitted      TRUE if cluster is freed after last journal commit, reuse must commit first
+ * @param free_commit_stamp     Journal commit count when free_uncommitted is set
  */
 struct FAT32DriverState {
-    struct FAT32FileAllocationTable fat_table;
-    struct FAT32DirectoryTable      dir_table_buf;
     struct ClusterBuffer            cluster_buf;
+    uint32_t                        cluster_block_count;
+    uint32_t                        cluster_count;
+    uint32_t                        fat_cluster_count;
+    uint32_t                        fat_extension_cluster;
+    uint32_t                        index_root_cluster;
+    uint32_t                        refcount_cluster;
+    uint32_t                        journal_cluster;
+    uint32_t                        zero_policy;
+    uint32_t                        tail_cluster;
+    uint32_t                        tail_candidate[TAIL_CANDIDATE_COUNT];
+    uint32_t                        tail_candidate_next;
+    uint32_t                        free_cluster_bitmap[FAT32_MAX_CLUSTER_COUNT / 32];
+    uint32_t                        free_cluster_count;
+    uint32_t                        next_free_cluster;
+    uint32_t                        scrub_cluster_bitmap[FAT32_MAX_CLUSTER_COUNT / 32];
+    uint32_t                        scrub_cluster_count;
+    bool                            free_uncommitted;
+    uint32_t                        free_commit_stamp;
+} __attribute__((packed));
+
+// Driver state of mounted volume, CLUSTER_SIZE is read from here
+extern struct FAT32DriverState driver_state;
+
+/**
+ * FAT32FileStat - Result of stat_file()
+ *
+ * @param filesize       Exact file size in byte, 0 for directory
+ * @param cluster_count  Length of cluster chain, 0 for tail packed file
+ * @param first_cluster  First cluster of chain, tail cluster for tail packed file
+ * @param attribute      Entry attribute, ATTR_SUBDIRECTORY for directory
+ * @param user_attribute Entry user attribute
+ */
+struct FAT32FileStat {
+    uint32_t filesize;
+    uint32_t cluster_count;
+    uint32_t first_cluster;
+    uint8_t  attribute;
+    uint8_t  user_attribute;
 } __attribute__((packed));
 
 /**
@@ -157,6 +530,7 @@ struct FAT32DriverState {
  * @param ext                   Extension for file
  * @param parent_cluster_number Parent directory cluster number, for updating metadata
  * @param buffer_size           Buffer size, CRUD operation will have different behaviour with this attribute
+ * @param offset                Byte offset inside file, only used by read_range() & write_range()
  */
 struct FAT32DriverRequest {
     void     *buf;
@@ -164,6 +538,7 @@ struct FAT32DriverRequest {
     char      ext[3];
     uint32_t  parent_cluster_number;
     uint32_t  buffer_size;
+    uint32_t  offset;
 } __attribute__((packed));
 
 
@@ -197,18 +572,44 @@ bool is_empty_storage(void);
 /**
  * Create new FAT32 file system. Will write fs_signature into boot sector and 
  * proper FileAllocationTable (contain CLUSTER_0_VALUE, CLUSTER_1_VALUE, 
- * and initialized root directory) into cluster number 1
+ * and initialized root directory) into cluster number 1.
+ * FAT size follow disk capacity from get_disk_block_count(), capped at FAT32_MAX_CLUSTER_COUNT.
+ * Cluster size is taken from set_format_cluster_size()
  */
 void create_fat32(void);
 
+/**
+ * Choose cluster size of volume created by next create_fat32(), existing volume keep its own
+ *
+ * @param cluster_size Cluster size in byte, power of two from CLUSTER_MIN_BLOCK_COUNT to CLUSTER_MAX_BLOCK_COUNT block
+ * @return             Error code: 0 success - -1 unsupported size
+ */
+int8_t set_format_cluster_size(uint32_t cluster_size);
+
 /**
  * Initialize file system driver state, if is_empty_storage() then create_fat32()
- * Else, read and cache entire FileAllocationTable (located at cluster number 1) into driver state
+ * Else, load volume geometry from FSInfo and build free cluster bitmap from FAT
  */
 void initialize_filesystem_fat32(void);
 
 /**
- * Write cluster operation, wrapper for write_blocks().
+ * Get FAT entry of cluster, FAT page is paged in through buffer cache
+ *
+ * @param cluster Cluster number, less than driver_state.cluster_count
+ * @return        Next cluster in chain, FAT32_FAT_END_OF_FILE, or FAT32_FAT_EMPTY_ENTRY
+ */
+uint32_t get_fat_entry(uint32_t cluster);
+
+/**
+ * Set FAT entry of cluster, FAT page become dirty in buffer cache
+ *
+ * @param cluster Cluster number, less than driver_state.cluster_count
+ * @param value   New FAT entry value
+ */
+void set_fat_entry(uint32_t cluster, uint32_t value);
+
+/**
+ * Write cluster operation, wrapper for cache_write_blocks().
  * Recommended to use struct ClusterBuffer
  * 
  * @param ptr            Pointer to source data
@@ -218,7 +619,7 @@ void initialize_filesystem_fat32(void);
 void write_clusters(const void *ptr, uint32_t cluster_number, uint8_t cluster_count);
 
 /**
- * Read cluster operation, wrapper for read_blocks().
+ * Read cluster operation, wrapper for cache_read_blocks().
  * Recommended to use struct ClusterBuffer
  * 
  * @param ptr            Pointer to buffer for reading
@@ -240,16 +641,16 @@ void read_clusters(void *ptr, uint32_t cluster_number, uint8_t cluster_count);
  *                name is directory name,
  *                ext is unused,
  *                parent_cluster_number is target directory table to read,
- *                buffer_size must be exactly sizeof(struct FAT32DirectoryTable)
+ *                buffer_size limit copied byte, at most first CLUSTER_SIZE byte of directory table
  * @return Error code: 0 success - 1 not a folder - 2 not found - -1 unknown
  */
 int8_t read_directory(struct FAT32DriverRequest request);
 
 
 /**
- * FAT32 read, read a file from file system.
+ * FAT32 read, read a file from file system. Exactly filesize byte is transferred
  *
- * @param request All attribute will be used for read, buffer_size will limit reading count
+ * @param request All attribute will be used for read, buffer_size must be at least filesize
  * @return Error code: 0 success - 1 not a file - 2 not enough buffer - 3 not found - -1 unknown
  */
 int8_t read(struct FAT32DriverRequest request);
@@ -262,10 +663,154 @@ int8_t read(struct FAT32DriverRequest request);
  */
 int8_t write(struct FAT32DriverRequest request);
 
+/**
+ * Zero fill freed cluster that still hold old content (ZERO_POLICY_LAZY), lowest cluster first
+ *
+ * @param max_count Maximum cluster to scrub in this call
+ * @return          Scrubbed cluster count
+ */
+uint32_t scrub_free_clusters(uint32_t max_count);
+
+/**
+ * Change freed cluster zeroing policy of volume, switching to ZERO_POLICY_EAGER scrub every pending cluster
+ *
+ * @param policy ZERO_POLICY_EAGER or ZERO_POLICY_LAZY
+ * @return       Error code: 0 success - -1 unknown policy
+ */
+int8_t set_zero_policy(uint32_t policy);
+
+/**
+ * Allocate single free cluster and mark it as FAT32_FAT_END_OF_FILE
+ *
+ * @return Cluster number, -1 if storage is full
+ */
 uint32_t get_empty_cluster();
 
+/**
+ * Find free contiguous cluster run, first run that can hold count clusters entirely is preferred,
+ * otherwise longest free run. Returned clusters is not marked as used.
+ *
+ * @param count      Wanted cluster count
+ * @param run_length Will be filled with returned run length, at most count, 0 if storage is full
+ * @return           First cluster number of the run
+ */
+uint32_t get_empty_cluster_run(uint32_t count, uint32_t *run_length);
+
+/**
+ * FAT32 read range, read part of file starting at request.offset like pread.
+ * Only clusters covering the range is read
+ *
+ * @param request     buffer_size is maximum byte count to read, offset is starting byte inside file
+ * @param transferred Output, byte count read, 0 if offset is at or beyond end of file
+ * @return Error code: 0 success - 1 not a file - 3 not found - -1 unknown
+ */
+int8_t read_range(struct FAT32DriverRequest request, uint32_t *transferred);
+
+/**
+ * FAT32 write range, overwrite or append buffer_size byte at request.offset of existing file like pwrite.
+ * File grow when range pass its end, gap between old end of file and offset is zero filled
+ *
+ * @param request buf & buffer_size is data to write, offset is starting byte inside file
+ * @return Error code: 0 success - 2 invalid parent - 3 not a file - 4 not found - -1 unknown / storage full
+ */
+int8_t write_range(struct FAT32DriverRequest request);
+
+/**
+ * FAT32 truncate, set size of existing file to request.offset byte.
+ * Shrink free cluster past new end, grow zero fill new range
+ *
+ * @param request offset is new file size, buf & buffer_size is unused
+ * @return Error code: 0 success - 2 invalid parent - 3 not a file - 4 not found - -1 unknown / storage full
+ */
+int8_t truncate_file(struct FAT32DriverRequest request);
+
+/**
+ * FAT32 stat, get size, cluster count & attribute of file or directory entry
+ *
+ * @param request name, ext, & parent_cluster_number is used
+ * @param stat    Output
+ * @return Error code: 0 success - 3 not found - -1 unknown
+ */
+int8_t stat_file(struct FAT32DriverRequest request, struct FAT32FileStat *stat);
+
+/**
+ * Open file, resolve its directory entry & map its cluster chain into extent
+ *
+ * @param request name, ext, & parent_cluster_number is used
+ * @param fd      Output, handle number
+ * @return Error code: 0 success - 1 not a file - 3 not found - -1 unknown / no free handle
+ */
+int8_t open_file(struct FAT32DriverRequest request, int32_t *fd);
+
+/**
+ * Read from handle position, position is advanced by transferred byte.
+ * Read stop at end of file
+ *
+ * @param fd          Handle number
+ * @param buf         Destination
+ * @param size        Maximum byte count
+ * @param transferred Output, byte count read
+ * @return Error code: 0 success - -1 invalid handle
+ */
+int8_t read_file(int32_t fd, void *buf, uint32_t size, uint32_t *transferred);
+
+/**
+ * Write at handle position, position is advanced by size.
+ * File grow when write pass its end, gap between old end and position is zero filled
+ *
+ * @param fd   Handle number
+ * @param buf  Source
+ * @param size Byte count
+ * @return Error code: 0 success - -1 invalid handle / storage full
+ */
+int8_t write_file(int32_t fd, const void *buf, uint32_t size);
+
+/**
+ * Move handle position, position may pass end of file
+ *
+ * @param fd       Handle number
+ * @param offset   Offset relative to whence
+ * @param whence   FILE_SEEK_SET, FILE_SEEK_CUR, or FILE_SEEK_END
+ * @param position Output, new position
+ * @return Error code: 0 success - -1 invalid handle / negative position
+ */
+int8_t seek_file(int32_t fd, int32_t offset, uint8_t whence, uint32_t *position);
+
+/**
+ * Close handle
+ *
+ * @param fd Handle number
+ * @return Error code: 0 success - -1 invalid handle
+ */
+int8_t close_file(int32_t fd);
+
+/**
+ * FAT32 rename, move directory entry of file or directory to new parent and / or name.
+ * No data cluster is read or written, moved directory get its parent pointer updated
+ *
+ * @param source name, ext, & parent_cluster_number of existing entry
+ * @param dest   name, ext, & parent_cluster_number of new entry
+ * @return Error code: 0 success - 1 not found - 2 dest already exist - 3 invalid parent -
+ *                     4 directory moved into itself - -1 unknown / storage full
+ */
+int8_t rename_entry(struct FAT32DriverRequest source, struct FAT32DriverRequest dest);
+
+/**
+ * FAT32 copy, copy file or whole directory tree into dest.
+ * By default file clusters is shared with source (reflink), shared cluster is duplicated
+ * only when either file later modify it. Directory itself is always created new
+ *
+ * @param source    name, ext, & parent_cluster_number of existing entry
+ * @param dest      name, ext, & parent_cluster_number of new entry
+ * @param full_copy Duplicate every data cluster instead of sharing
+ * @return Error code: 0 success - 1 not found - 2 dest already exist - 3 invalid parent -
+ *                     4 directory copied into itself - -1 unknown / storage full
+ */
+int8_t copy_entry(struct FAT32DriverRequest source, struct FAT32DriverRequest dest, bool full_copy);
+
 /**
  * FAT32 delete, delete a file or empty directory (only 1 DirectoryEntry) in file system.
+ * Whole cluster chain of file / directory is freed, cluster shared with other file only lose one reference
  *
  * @param request buf and buffer_size is unused
  * @return Error code: 0 success - 1 not found - 2 folder is not empty - -1 unknown
@@ -276,20 +821,93 @@ void initialize_root(void);
 
 void reset_entry(struct FAT32DirectoryEntry *entry);
 
+/**
+ * Get full path of directory, answered from path cache. Uncached path is built from
+ * cached parent path, so only uncached ancestor is read from storage
+ *
+ * @param buffer                   Output, at least DIR_PATH_MAX_LENGTH byte
+ * @param directory_cluster_number Directory cluster
+ */
 void get_dir_path(char* buffer, uint32_t directory_cluster_number);
 
-void get_children(char* buffer, uint32_t directory_cluster_number);
+/**
+ * Resolve full path of many directory at once
+ *
+ * @param request Batch request, see struct DirPathBatchRequest
+ * @return        Number of path written, stop early when buffer is full
+ */
+uint32_t get_dir_path_batch(struct DirPathBatchRequest request);
+
+/**
+ * List children of directory into buffer, one name per line & null terminated.
+ * Listing stream along directory cluster chain, stop before buffer_size is exceeded
+ *
+ * @param buffer                   Output buffer
+ * @param buffer_size              Output buffer size in byte
+ * @param directory_cluster_number Directory to list
+ * @param cursor                   Entry to continue from (0 from beginning), updated with next entry
+ *                                 or 0 if listing is finished. Can be 0 for single batch
+ */
+void get_children(char* buffer, uint32_t buffer_size, uint32_t directory_cluster_number, uint32_t *cursor);
 
 uint32_t move_to_child_directory(struct FAT32DriverRequest request);
 
 uint32_t move_to_parent_directory(struct FAT32DriverRequest request);
 
+/**
+ * Resolve directory path in single call, every component is looked up through dentry cache.
+ * Component separated by '/', "." & ".." is supported, leading '/' start from root.
+ * Component without extension refer to directory (ext "dir")
+ *
+ * @param path          Null terminated path
+ * @param start_cluster Directory where relative path start
+ * @return              Cluster of resolved directory, 0 if any component is missing or not directory
+ */
+uint32_t resolve_path(const char *path, uint32_t start_cluster);
+
+/**
+ * Create empty name index B+tree, root leaf located at INDEX_CLUSTER_NUMBER
+ */
 void init_index_file();
 
-void insert_index(char* name, char* ext, uint32_t parent_cluster_number);
+/**
+ * Insert entry into name index B+tree, only node on path from root to leaf is touched
+ *
+ * @param name                  Entry name
+ * @param ext                   Entry extension
+ * @param parent_cluster_number Directory containing entry
+ * @return                      0 success, -1 if storage cannot hold split or out of kernel memory (index is unchanged)
+ */
+int8_t insert_index(char* name, char* ext, uint32_t parent_cluster_number);
+
+/**
+ * Find every directory containing entry with exact name & ext
+ *
+ * @param buffer       Output, parent cluster number of every match
+ * @param buffer_count Capacity of buffer in cluster number
+ * @param name         Entry name
+ * @param ext          Entry extension
+ * @return             Number of match written into buffer
+ */
+uint32_t search_index(uint32_t* buffer, uint32_t buffer_count, char* name, char* ext);
 
-uint32_t search_index(uint32_t* buffer, char* name, char* ext);
+/**
+ * Find entry matching pattern. Pattern is "name.ext" or "name" (any extension),
+ * '*' match any sequence and '?' match any single character.
+ * Literal prefix of name before first wildcard is used as B+tree range, so prefix query touch only matching leaves
+ *
+ * @param buffer       Output, matching entries in key order
+ * @param buffer_count Capacity of buffer in entry
+ * @param pattern      Null terminated pattern
+ * @return             Number of entry written into buffer
+ */
+uint32_t search_index_pattern(struct IndexEntry *buffer, uint32_t buffer_count, const char *pattern);
 
+/**
+ * Remove entry from name index B+tree, leaf is not merged even if it become empty
+ *
+ * @return 0, -1 if node buffer cannot be allocated
+ */
 int delete_index(char* name, char* ext, uint32_t parent_cluster_number);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,97 @@
+#ifndef _HEAP_H
+#define _HEAP_H
+
+#include "stdtype.h"
+
+// Kernel heap virtual range, right after higher half kernel 4 MiB page. Mapped with 4 MiB page on demand
+#define KERNEL_HEAP_VIRTUAL_BASE 0xC0400000
+#define KERNEL_HEAP_FRAME_COUNT  8
+
+// Heap is split into SLAB_SIZE slab, each slab serve single size class
+#define SLAB_SIZE                (64*1024)
+#define SLAB_COUNT               (KERNEL_HEAP_FRAME_COUNT*(4*1024*1024)/SLAB_SIZE)
+#define SLAB_NONE                0xFFFF
+
+// Size class i serve object up to (HEAP_MIN_OBJECT_SIZE << i) bytes, 16 B - 32 KiB
+#define HEAP_MIN_OBJECT_SIZE     16
+#define HEAP_SIZE_CLASS_COUNT    12
+#define HEAP_MAX_OBJECT_SIZE     (HEAP_MIN_OBJECT_SIZE << (HEAP_SIZE_CLASS_COUNT - 1))
+#define HEAP_SIZE_CLASS_FREE     0xFF
+
+/**
+ * Slab descriptor, kept outside slab so object can use whole slab
+ *
+ * @param free_head    Most recently freed object of this slab, object store next free object in its first 4 byte
+ * @param used_count   Allocated object count
+ * @param carved_count Object handed out at least once, object after it is never used and not linked in free list
+ * @param next         Next slab in size class partial list or free slab list
+ * @param prev         Previous slab in size class partial list
+ * @param size_class   Size class index, HEAP_SIZE_CLASS_FREE if slab is unused
+ */
+struct HeapSlab {
+    void    *free_head;
+    uint16_t used_count;
+    uint16_t carved_count;
+    uint16_t next;
+    uint16_t prev;
+    uint8_t  size_class;
+} __attribute__((packed));
+
+/**
+ * Usage statistic of single size class
+ *
+ * @param object_size  Object size served by this class
+ * @param slab_count   Slab currently assigned to this class
+ * @param used_count   Allocated object count
+ * @param alloc_count  Total successful kmalloc() on this class
+ * @param free_count   Total kfree() on this class
+ */
+struct HeapSizeClassStats {
+    uint32_t object_size;
+    uint32_t slab_count;
+    uint32_t used_count;
+    uint32_t alloc_count;
+    uint32_t free_count;
+} __attribute__((packed));
+
+/**
+ * Kernel heap usage statistic
+ *
+ * @param mapped_frame_count Frame mapped into heap virtual range
+ * @param free_slab_count    Slab mapped but not assigned to any size class
+ * @param failed_count       Total kmalloc() returning 0
+ * @param size_class         Per size class statistic
+ */
+struct HeapStats {
+    uint32_t mapped_frame_count;
+    uint32_t free_slab_count;
+    uint32_t failed_count;
+    struct HeapSizeClassStats size_class[HEAP_SIZE_CLASS_COUNT];
+} __attribute__((packed));
+
+
+
+/**
+ * Allocate kernel memory from smallest size class that fit, content is not initialized.
+ * Object is aligned to its size class.
+ *
+ * @param  size   Requested byte count, at most HEAP_MAX_OBJECT_SIZE
+ * @return void*  Allocated object, 0 if size is 0 / too large or heap is exhausted
+ */
+void *kmalloc(uint32_t size);
+
+/**
+ * Return object allocated by kmalloc(). Slab is returned into free slab list when its last object is freed
+ *
+ * @param ptr Object to free, 0 is ignored
+ */
+void kfree(void *ptr);
+
+/**
+ * Get kernel heap usage statistic
+ *
+ * @param stats Pointer to struct HeapStats to be filled
+ */
+void get_heap_stats(struct HeapStats *stats);
+
+#endif
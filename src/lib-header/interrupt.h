@@ -96,7 +96,7 @@ struct InterruptStack {
 
 
 
-// Activate PIC mask for keyboard only
+// Activate PIC mask for keyboard and primary ATA (IRQ14, through slave PIC cascade)
 void activate_keyboard_interrupt(void);
 
 // I/O port wait, around 1-4 microsecond, for I/O synchronization purpose
@@ -142,4 +142,12 @@ void puts(char* str, uint32_t len, uint32_t fg);
 
 void syscall(struct CPURegister cpu, __attribute__((unused)) struct InterruptStack info);
 
+/**
+ * Page fault (#PF, vector 14) handler. Populate demand paged user page at CR2,
+ * halt if fault cannot be resolved instead of restarting faulting instruction forever.
+ * 
+ * @param info Interrupt information, error_code contain PAGE_FAULT_* bit
+ */
+void page_fault_handler(struct InterruptStack info);
+
 #endif
\ No newline at end of file
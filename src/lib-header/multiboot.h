@@ -0,0 +1,55 @@
+#ifndef _MULTIBOOT_H
+#define _MULTIBOOT_H
+
+#include "stdtype.h"
+
+// Value of eax when kernel is loaded by multiboot compliant bootloader
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+
+// MultibootInfo.flags, indicating which field is valid
+#define MULTIBOOT_INFO_MEMORY      0b00000001
+#define MULTIBOOT_INFO_MEMORY_MAP  0b01000000
+
+// MultibootMemoryMap.type
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+/**
+ * Multiboot information structure, passed by bootloader at ebx (physical address).
+ * Only field up to memory map is defined, check Multiboot Specification 0.6.96 - 3.3 Boot information format
+ *
+ * @param flags       Bitmask of MULTIBOOT_INFO_*, field without its flag must not be read
+ * @param mem_lower   Lower memory size in KiB, start from address 0
+ * @param mem_upper   Upper memory size in KiB, start from address 1 MiB
+ * @param mmap_length Size of memory map buffer in bytes
+ * @param mmap_addr   Physical address of first struct MultibootMemoryMap
+ */
+struct MultibootInfo {
+    uint32_t flags;
+    uint32_t mem_lower;
+    uint32_t mem_upper;
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+} __attribute__((packed));
+
+/**
+ * Multiboot memory map entry. Entries are variable sized,
+ * next entry located at (entry address + size + sizeof(size))
+ *
+ * @param size      Size of this entry excluding this field
+ * @param base_addr Physical start address of memory region
+ * @param length    Memory region length in bytes
+ * @param type      MULTIBOOT_MEMORY_AVAILABLE for usable RAM, other value is reserved
+ */
+struct MultibootMemoryMap {
+    uint32_t size;
+    uint64_t base_addr;
+    uint64_t length;
+    uint32_t type;
+} __attribute__((packed));
+
+#endif
@@ -2,10 +2,47 @@
 #define _PAGING_H
 
 #include "stdtype.h"
+#include "multiboot.h"
 
 #define PAGE_ENTRY_COUNT 1024
 #define PAGE_FRAME_SIZE  (4*1024*1024)
 
+// Second level page table, PAGE_SIZE page
+#define PAGE_SIZE                 (4*1024)
+#define PAGE_PER_FRAME            (PAGE_FRAME_SIZE/PAGE_SIZE)
+// Statically allocated page table, each covering PAGE_FRAME_SIZE of virtual memory
+#define PAGE_TABLE_POOL_COUNT     16
+// Maximum number of frame split into PAGE_SIZE page at once
+#define SMALL_PAGE_FRAME_COUNT    8
+
+// User program layout, image is loaded at virtual address 0 and stack grow down from USER_STACK_TOP
+#define USER_PROGRAM_MAX_SIZE     (1*1024*1024)
+#define USER_STACK_TOP            PAGE_FRAME_SIZE
+#define USER_STACK_SIZE           (64*1024)
+
+// Per process page directory, id 0 is _paging_kernel_page_directory & the rest is statically allocated pool.
+// Entry from PAGE_DIRECTORY_KERNEL_INDEX onward map higher half kernel and is shared by every directory
+#define PAGE_DIRECTORY_COUNT        8
+#define PAGE_DIRECTORY_KERNEL_ID    0
+#define PAGE_DIRECTORY_KERNEL_INDEX (KERNEL_VIRTUAL_BASE >> 22)
+
+// Demand paged user region, populated by page fault handler on first touch
+#define USER_REGION_COUNT         8
+
+// Page fault error code, check Intel Manual 3a - 4.7 Page-Fault Exceptions
+#define PAGE_FAULT_PRESENT_BIT    0b001
+#define PAGE_FAULT_WRITE_BIT      0b010
+#define PAGE_FAULT_USER_BIT       0b100
+
+// Physical frame allocator, one bit per PAGE_FRAME_SIZE frame covering 4 GiB physical address space
+#define PAGE_FRAME_MAX_COUNT      PAGE_ENTRY_COUNT
+#define PAGE_FRAME_BITMAP_SIZE    (PAGE_FRAME_MAX_COUNT/8)
+// Assumed physical memory size when bootloader does not provide any memory information
+#define PAGE_FRAME_FALLBACK_COUNT 32
+
+// Higher half kernel offset, kernel physical address = virtual address - KERNEL_VIRTUAL_BASE
+#define KERNEL_VIRTUAL_BASE 0xC0000000
+
 // Operating system page directory, using page size PAGE_FRAME_SIZE (4 MiB)
 extern struct PageDirectory _paging_kernel_page_directory;
 
@@ -62,13 +99,126 @@ struct PageDirectory {
     struct PageDirectoryEntry table[PAGE_ENTRY_COUNT] __attribute__((aligned(0x1000)));
 } __attribute__((packed));
 
+/**
+ * Page Table Entry, mapping single PAGE_SIZE page.
+ * Check Intel Manual 3a - Ch 4 Paging - Figure 4-4 PTE: 4KB page
+ * 
+ * @param present_bit          Indicate whether this entry is exist or not
+ * @param page_attribute_table PAT bit, at same position as use_pagesize_4_mb in PageDirectoryEntryFlag
+ * @param global_page          Is this page translation global
+ * @param address              Physical address of page, shifted right by 12
+ * ...
+ */
+struct PageTableEntry {
+    uint32_t present_bit          : 1;
+    uint32_t write_bit            : 1;
+    uint32_t supervisor_bit       : 1;
+    uint32_t write_through_bit    : 1;
+    uint32_t cache_disable_bit    : 1;
+    uint32_t accessed_bit         : 1;
+    uint32_t dirty_bit            : 1;
+    uint32_t page_attribute_table : 1;
+    uint32_t global_page          : 1;
+    uint32_t available            : 3;
+    uint32_t address              : 20;
+} __attribute__((packed));
+
+/**
+ * Page Table, referenced by PageDirectoryEntry with use_pagesize_4_mb = 0.
+ * Same alignment rule as PageDirectory
+ * 
+ * @param table Fixed-width array of PageTableEntry with size PAGE_ENTRY_COUNT
+ */
+struct PageTable {
+    struct PageTableEntry table[PAGE_ENTRY_COUNT] __attribute__((aligned(0x1000)));
+} __attribute__((packed));
+
+/**
+ * Demand paged user virtual memory region. Page is allocated zero-filled on first access,
+ * first file_size bytes of region is read from file.
+ * 
+ * @param virtual_addr          Region start, multiple of PAGE_SIZE. Region with size 0 is unused
+ * @param size                  Region size in bytes
+ * @param file_size             Byte count backed by file, 0 for anonymous region
+ * @param name                  Backing file name
+ * @param ext                   Backing file extension
+ * @param parent_cluster_number Backing file parent directory cluster number
+ */
+struct UserPageRegion {
+    uint32_t virtual_addr;
+    uint32_t size;
+    uint32_t file_size;
+    char     name[8];
+    char     ext[3];
+    uint32_t parent_cluster_number;
+} __attribute__((packed));
+
 /**
  * Containing page driver states
  * 
- * @param last_available_physical_addr Pointer to last empty physical addr (multiple of 4 MiB)
+ * @param frame_usable_bitmap Bit set when frame is fully backed by available RAM and not reserved by kernel
+ * @param frame_used_bitmap   Bit set when frame is allocated or not usable
+ * @param last_frame          Last allocated frame index, next search start after it
+ * @param usable_frame_count  Number of bit set in frame_usable_bitmap
+ * @param free_frame_count    Number of usable frame that is not allocated
+ * @param allocate_count      Total successful frame allocation
+ * @param free_count          Total successful frame release
+ * @param page_table_used     Number of mapped page in respective page table, 0 if page table is unused
+ * @param small_frame_addr    Physical address of frame split into PAGE_SIZE page, 0 for empty slot
+ * @param small_frame_used    Number of allocated page in respective small frame
+ * @param small_page_bitmap   Allocated page bitmap of respective small frame
+ * @param current_directory   Page directory id loaded in CR3, user memory operation apply to this directory
+ * @param directory_used      Nonzero if respective page directory id is allocated
+ * @param user_region         Demand paged user region of respective page directory
+ * @param page_fault_count    Total page fault resolved by allocating page
+ * @param file_page_count     Total page fault resolved by reading file
  */
 struct PageDriverState {
-    uint8_t *last_available_physical_addr;
+    uint8_t  frame_usable_bitmap[PAGE_FRAME_BITMAP_SIZE];
+    uint8_t  frame_used_bitmap[PAGE_FRAME_BITMAP_SIZE];
+    uint32_t last_frame;
+    uint32_t usable_frame_count;
+    uint32_t free_frame_count;
+    uint32_t allocate_count;
+    uint32_t free_count;
+    uint16_t page_table_used[PAGE_TABLE_POOL_COUNT];
+    uint32_t small_frame_addr[SMALL_PAGE_FRAME_COUNT];
+    uint16_t small_frame_used[SMALL_PAGE_FRAME_COUNT];
+    uint8_t  small_page_bitmap[SMALL_PAGE_FRAME_COUNT][PAGE_PER_FRAME/8];
+    uint32_t current_directory;
+    uint8_t  directory_used[PAGE_DIRECTORY_COUNT];
+    struct UserPageRegion user_region[PAGE_DIRECTORY_COUNT][USER_REGION_COUNT];
+    uint32_t page_fault_count;
+    uint32_t file_page_count;
+} __attribute__((packed));
+
+/**
+ * Physical frame allocator usage statistic
+ * 
+ * @param frame_size         Size of single frame in bytes
+ * @param usable_frame_count Frame available for allocation at boot
+ * @param free_frame_count   Frame currently free
+ * @param allocate_count     Total successful frame allocation
+ * @param free_count         Total successful frame release
+ * @param small_frame_count  Frame currently split into PAGE_SIZE page
+ * @param small_page_count   PAGE_SIZE page currently allocated
+ * @param page_table_count   Page table currently in use
+ * @param page_fault_count   Total page fault resolved by allocating page
+ * @param file_page_count    Total page fault resolved by reading file
+ * @param directory_count    Page directory currently allocated, including kernel page directory
+ */
+struct PageFrameStats {
+    uint32_t frame_size;
+    uint32_t usable_frame_count;
+    uint32_t free_frame_count;
+    uint32_t allocate_count;
+    uint32_t free_count;
+    uint32_t small_frame_count;
+    uint32_t small_page_count;
+    uint32_t page_table_count;
+    uint32_t page_fault_count;
+    uint32_t file_page_count;
+    uint32_t directory_count;
 } __attribute__((packed));
 
 
@@ -76,14 +226,15 @@ struct PageDriverState {
 
 
 /**
- * update_page_directory,
- * Edit _paging_kernel_page_directory with respective parameter
+ * update_page_directory_entry,
+ * Edit current page directory with respective parameter. Higher half kernel address is global mapping,
+ * it is written into every page directory with global_page set, so it survive CR3 switch in TLB.
  * 
  * @param physical_addr Physical address to map
  * @param virtual_addr  Virtual address to map
  * @param flag          Page entry flags
  */
-void update_page_directory(void *physical_addr, void *virtual_addr, struct PageDirectoryEntryFlag flag);
+void update_page_directory_entry(void *physical_addr, void *virtual_addr, struct PageDirectoryEntryFlag flag);
 
 /**
  * flush_single_tlb, 
@@ -96,10 +247,143 @@ void flush_single_tlb(void *virtual_addr);
 /**
  * Allocate user memory into specified virtual memory address.
  * Multiple call on same virtual address will unmap previous physical address and change it into new one.
+ * Virtual address range must not contain PAGE_SIZE page (allocate_single_user_page()).
  * 
  * @param  virtual_addr Virtual address to be mapped
  * @return int8_t       0 success, -1 for failed allocation
  */
 int8_t allocate_single_user_page_frame(void *virtual_addr);
 
+/**
+ * Unmap user memory at specified virtual address and return its physical frame to allocator.
+ * 
+ * @param  virtual_addr Virtual address previously mapped by allocate_single_user_page_frame()
+ * @return int8_t       0 success, -1 if virtual address is not mapped
+ */
+int8_t free_single_user_page_frame(void *virtual_addr);
+
+/**
+ * Allocate single PAGE_SIZE user page into specified virtual address, page is zero-filled.
+ * Virtual address range must not be mapped by 4 MiB page (allocate_single_user_page_frame()).
+ * 
+ * @param  virtual_addr Virtual address to be mapped, rounded down to PAGE_SIZE
+ * @return int8_t       0 success, -1 if out of memory / page table or range is mapped by 4 MiB page
+ */
+int8_t allocate_single_user_page(void *virtual_addr);
+
+/**
+ * Unmap PAGE_SIZE user page and return its physical page to allocator.
+ * Page table is released when its last page is unmapped.
+ * 
+ * @param  virtual_addr Virtual address previously mapped by allocate_single_user_page()
+ * @return int8_t       0 success, -1 if virtual address is not mapped by PAGE_SIZE page
+ */
+int8_t free_single_user_page(void *virtual_addr);
+
+/**
+ * Allocate every PAGE_SIZE user page covering [virtual_addr, virtual_addr + size)
+ * 
+ * @param  virtual_addr Start of virtual range
+ * @param  size         Range size in bytes
+ * @return int8_t       0 success, -1 if any page failed to be allocated
+ */
+int8_t allocate_user_pages(void *virtual_addr, uint32_t size);
+
+/**
+ * Create page directory for new process, higher half kernel mapping is shared & user half is empty
+ * 
+ * @param  directory_id Pointer to store new page directory id
+ * @return int8_t       0 success, -1 if every page directory is used
+ */
+int8_t create_page_directory(uint32_t *directory_id);
+
+/**
+ * Load page directory into CR3. User memory operation & page fault handling apply to this directory afterward.
+ * Global kernel TLB entry is not flushed.
+ * 
+ * @param  directory_id Page directory id
+ * @return int8_t       0 success, -1 if page directory is not allocated
+ */
+int8_t switch_page_directory(uint32_t directory_id);
+
+/**
+ * Release every user page, page table & region of page directory and free it
+ * 
+ * @param  directory_id Page directory id, must not be current or kernel page directory
+ * @return int8_t       0 success, -1 if page directory cannot be destroyed
+ */
+int8_t destroy_page_directory(uint32_t directory_id);
+
+/**
+ * Register demand paged user region in current page directory, no page is allocated until it is accessed
+ * 
+ * @param  region Region to register, virtual_addr must be PAGE_SIZE aligned
+ * @return int8_t 0 success, -1 if region is invalid, overlapping or no free region slot
+ */
+int8_t add_user_page_region(struct UserPageRegion region);
+
+/**
+ * Unmap every page of registered user region and remove all region of current page directory
+ */
+void clear_user_page_regions(void);
+
+/**
+ * Page fault handler, populate missing page inside registered user region
+ * 
+ * @param  fault_addr Faulting virtual address (CR2)
+ * @param  error_code Page fault error code, PAGE_FAULT_* bit
+ * @return bool       TRUE if page is populated and faulting instruction can be restarted
+ */
+bool handle_page_fault(void *fault_addr, uint32_t error_code);
+
+/**
+ * Populate every missing page of registered user region inside [virtual_addr, virtual_addr + size).
+ * Used before filesystem operation touch user buffer, so file backed page is not faulted in
+ * while filesystem is in the middle of another operation.
+ * 
+ * @param virtual_addr Start of virtual range
+ * @param size         Range size in bytes
+ */
+void populate_user_range(void *virtual_addr, uint32_t size);
+
+/**
+ * Populate every missing page of null terminated user string, page by page until terminator is found.
+ * Stop at first page outside registered region.
+ * 
+ * @param string Start of user string
+ */
+void populate_user_string(const char *string);
+
+/**
+ * Build physical frame allocator from multiboot memory map.
+ * Fall back to mem_upper, then PAGE_FRAME_FALLBACK_COUNT frames, if memory map is not provided.
+ * Frames occupied by kernel image are always reserved.
+ * 
+ * @param multiboot_info Virtual address of multiboot information, 0 if not booted by multiboot loader
+ */
+void initialize_page_frame_allocator(struct MultibootInfo *multiboot_info);
+
+/**
+ * Allocate one free PAGE_FRAME_SIZE physical frame
+ * 
+ * @param  physical_addr Pointer to store allocated frame physical address
+ * @return int8_t        0 success, -1 if no free frame left
+ */
+int8_t allocate_page_frame(void **physical_addr);
+
+/**
+ * Return physical frame to allocator
+ * 
+ * @param  physical_addr Physical address of frame, must be PAGE_FRAME_SIZE aligned
+ * @return int8_t        0 success, -1 if address is unaligned, not usable or already free
+ */
+int8_t free_page_frame(void *physical_addr);
+
+/**
+ * Get physical frame allocator usage statistic
+ * 
+ * @param stats Pointer to struct PageFrameStats to be filled
+ */
+void get_page_frame_stats(struct PageFrameStats *stats);
+
 #endif
\ No newline at end of file
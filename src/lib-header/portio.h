@@ -23,4 +23,8 @@ uint16_t in16(uint16_t port);
 
 void out16(uint16_t port, uint16_t data);
 
+uint32_t in32(uint16_t port);
+
+void out32(uint16_t port, uint32_t data);
+
 #endif
\ No newline at end of file
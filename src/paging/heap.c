@@ -0,0 +1,149 @@
+#include "../lib-header/heap.h"
+#include "../lib-header/paging.h"
+
+#define SLAB_PER_FRAME (PAGE_FRAME_SIZE/SLAB_SIZE)
+
+static struct HeapSlab heap_slab[SLAB_COUNT];
+static uint16_t partial_slab_head[HEAP_SIZE_CLASS_COUNT] = {[0 ... HEAP_SIZE_CLASS_COUNT - 1] = SLAB_NONE};
+static uint16_t free_slab_head = SLAB_NONE;
+static struct HeapStats heap_stats = {0};
+
+static uint8_t *slab_address(uint16_t slab) {
+    return (uint8_t*) KERNEL_HEAP_VIRTUAL_BASE + (uint32_t) slab*SLAB_SIZE;
+}
+
+static uint32_t slab_capacity(uint8_t size_class) {
+    return SLAB_SIZE / (HEAP_MIN_OBJECT_SIZE << size_class);
+}
+
+static void partial_slab_push(uint16_t slab) {
+    uint8_t size_class    = heap_slab[slab].size_class;
+    heap_slab[slab].prev  = SLAB_NONE;
+    heap_slab[slab].next  = partial_slab_head[size_class];
+    if (partial_slab_head[size_class] != SLAB_NONE)
+        heap_slab[partial_slab_head[size_class]].prev = slab;
+    partial_slab_head[size_class] = slab;
+}
+
+static void partial_slab_remove(uint16_t slab) {
+    struct HeapSlab *descriptor = &heap_slab[slab];
+    if (descriptor->prev != SLAB_NONE)
+        heap_slab[descriptor->prev].next = descriptor->next;
+    else
+        partial_slab_head[descriptor->size_class] = descriptor->next;
+    if (descriptor->next != SLAB_NONE)
+        heap_slab[descriptor->next].prev = descriptor->prev;
+}
+
+/**
+ * Take unused slab, map new frame into heap virtual range if every mapped slab is used
+ *
+ * @return uint16_t Slab index, SLAB_NONE if heap range is full or out of physical frame
+ */
+static uint16_t take_free_slab(void) {
+    if (free_slab_head == SLAB_NONE) {
+        void *physical_addr;
+        if (heap_stats.mapped_frame_count == KERNEL_HEAP_FRAME_COUNT || allocate_page_frame(&physical_addr) != 0)
+            return SLAB_NONE;
+
+        struct PageDirectoryEntryFlag flag = {
+            .present_bit       = 1,
+            .write_bit         = 1,
+            .use_pagesize_4_mb = 1,
+        };
+        uint16_t first_slab = heap_stats.mapped_frame_count*SLAB_PER_FRAME;
+        update_page_directory_entry(physical_addr, slab_address(first_slab), flag);
+        heap_stats.mapped_frame_count++;
+
+        // Push in reverse, lower address is used first
+        for (uint16_t slab = first_slab + SLAB_PER_FRAME; slab-- > first_slab; ) {
+            heap_slab[slab].size_class = HEAP_SIZE_CLASS_FREE;
+            heap_slab[slab].next       = free_slab_head;
+            free_slab_head             = slab;
+        }
+        heap_stats.free_slab_count += SLAB_PER_FRAME;
+    }
+
+    uint16_t slab  = free_slab_head;
+    free_slab_head = heap_slab[slab].next;
+    heap_stats.free_slab_count--;
+    return slab;
+}
+
+void *kmalloc(uint32_t size) {
+    if (size == 0 || size > HEAP_MAX_OBJECT_SIZE) {
+        heap_stats.failed_count++;
+        return 0;
+    }
+    uint8_t size_class = 0;
+    while ((uint32_t) (HEAP_MIN_OBJECT_SIZE << size_class) < size)
+        size_class++;
+
+    uint16_t slab = partial_slab_head[size_class];
+    if (slab == SLAB_NONE) {
+        slab = take_free_slab();
+        if (slab == SLAB_NONE) {
+            heap_stats.failed_count++;
+            return 0;
+        }
+        // Object is carved lazily, new slab does not need free list initialization
+        heap_slab[slab].size_class   = size_class;
+        heap_slab[slab].used_count   = 0;
+        heap_slab[slab].carved_count = 0;
+        heap_slab[slab].free_head    = 0;
+        partial_slab_push(slab);
+        heap_stats.size_class[size_class].slab_count++;
+    }
+
+    struct HeapSlab *descriptor = &heap_slab[slab];
+    void *object;
+    if (descriptor->free_head != 0) {
+        object                = descriptor->free_head;
+        descriptor->free_head = *(void**) object;
+    } else {
+        object = slab_address(slab) + (uint32_t) descriptor->carved_count*(HEAP_MIN_OBJECT_SIZE << size_class);
+        descriptor->carved_count++;
+    }
+    descriptor->used_count++;
+    if (descriptor->used_count == slab_capacity(size_class))
+        partial_slab_remove(slab);
+
+    heap_stats.size_class[size_class].used_count++;
+    heap_stats.size_class[size_class].alloc_count++;
+    return object;
+}
+
+void kfree(void *ptr) {
+    uint32_t offset = (uint32_t) ptr - KERNEL_HEAP_VIRTUAL_BASE;
+    if (ptr == 0 || (uint32_t) ptr < KERNEL_HEAP_VIRTUAL_BASE
+            || offset >= heap_stats.mapped_frame_count*PAGE_FRAME_SIZE)
+        return;
+    uint16_t slab = offset / SLAB_SIZE;
+    struct HeapSlab *descriptor = &heap_slab[slab];
+    uint8_t size_class = descriptor->size_class;
+    if (size_class == HEAP_SIZE_CLASS_FREE)
+        return;
+
+    if (descriptor->used_count == slab_capacity(size_class))
+        partial_slab_push(slab);
+    *(void**) ptr         = descriptor->free_head;
+    descriptor->free_head = ptr;
+    descriptor->used_count--;
+    heap_stats.size_class[size_class].used_count--;
+    heap_stats.size_class[size_class].free_count++;
+
+    if (descriptor->used_count == 0) {
+        partial_slab_remove(slab);
+        descriptor->size_class = HEAP_SIZE_CLASS_FREE;
+        descriptor->next       = free_slab_head;
+        free_slab_head         = slab;
+        heap_stats.free_slab_count++;
+        heap_stats.size_class[size_class].slab_count--;
+    }
+}
+
+void get_heap_stats(struct HeapStats *stats) {
+    *stats = heap_stats;
+    for (uint8_t i = 0; i < HEAP_SIZE_CLASS_COUNT; i++)
+        stats->size_class[i].object_size = HEAP_MIN_OBJECT_SIZE << i;
+}
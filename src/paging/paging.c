@@ -1,4 +1,8 @@
 #include "../lib-header/paging.h"
+#include "../lib-header/stdmem.h"
+#include "../lib-header/gdt.h"
+#include "../lib-header/kernel_loader.h"
+#include "../lib-header/fat32.h"
 
 __attribute__((aligned(0x1000))) struct PageDirectory _paging_kernel_page_directory = {
     .table = {
@@ -13,35 +17,559 @@ __attribute__((aligned(0x1000))) struct PageDirectory _paging_kernel_page_direct
             .flag.write_bit         = 1,
             .lower_address          = 0,
             .flag.use_pagesize_4_mb = 1,
+            .global_page            = 1,
         },
     }
 };
 
-static struct PageDriverState page_driver_state = {
-    .last_available_physical_addr = (uint8_t*) 0 + PAGE_FRAME_SIZE,
-};
+static struct PageDriverState page_driver_state = {0};
+
+// Second level page table, located in kernel image so physical address = virtual address - KERNEL_VIRTUAL_BASE
+static struct PageTable page_table_pool[PAGE_TABLE_POOL_COUNT] __attribute__((aligned(0x1000)));
+
+// Process page directory, id 1 onward. Also located in kernel image
+static struct PageDirectory page_directory_pool[PAGE_DIRECTORY_COUNT - 1] __attribute__((aligned(0x1000)));
+
+static struct PageDirectory *get_page_directory(uint32_t directory_id) {
+    if (directory_id == PAGE_DIRECTORY_KERNEL_ID)
+        return &_paging_kernel_page_directory;
+    return &page_directory_pool[directory_id - 1];
+}
+
+static struct PageDirectory *current_page_directory(void) {
+    return get_page_directory(page_driver_state.current_directory);
+}
+
+static struct UserPageRegion *current_user_region(void) {
+    return page_driver_state.user_region[page_driver_state.current_directory];
+}
+
+static bool is_frame_bit_set(uint8_t *bitmap, uint32_t frame) {
+    return (bitmap[frame / 8] >> (frame % 8)) & 1;
+}
+
+static void set_frame_bit(uint8_t *bitmap, uint32_t frame, bool value) {
+    if (value)
+        bitmap[frame / 8] |= 1 << (frame % 8);
+    else
+        bitmap[frame / 8] &= ~(1 << (frame % 8));
+}
+
+/**
+ * Mark every frame that is fully inside physical range [base, base + length) as usable
+ * 
+ * @param base   Physical start address of available region
+ * @param length Region length in bytes
+ */
+static void mark_usable_region(uint64_t base, uint64_t length) {
+    uint64_t limit = (uint64_t) PAGE_FRAME_MAX_COUNT * PAGE_FRAME_SIZE;
+    uint64_t end   = base + length;
+    if (end > limit)
+        end = limit;
+    if (base >= end)
+        return;
+
+    // Shift instead of division, 64-bit division need libgcc
+    uint32_t first_frame = (base + PAGE_FRAME_SIZE - 1) >> 22;
+    uint32_t last_frame  = end >> 22;
+    for (uint32_t frame = first_frame; frame < last_frame; frame++)
+        set_frame_bit(page_driver_state.frame_usable_bitmap, frame, TRUE);
+}
+
+/**
+ * Read available region from multiboot memory map.
+ * Only first PAGE_FRAME_SIZE of physical memory is mapped into kernel, map located above it is ignored.
+ * 
+ * @return bool TRUE if memory map is present and readable
+ */
+static bool read_multiboot_memory_map(struct MultibootInfo *multiboot_info) {
+    if (!(multiboot_info->flags & MULTIBOOT_INFO_MEMORY_MAP))
+        return FALSE;
+    uint32_t mmap_addr   = multiboot_info->mmap_addr;
+    uint32_t mmap_length = multiboot_info->mmap_length;
+    if (mmap_length == 0 || mmap_addr >= PAGE_FRAME_SIZE || mmap_length > PAGE_FRAME_SIZE - mmap_addr)
+        return FALSE;
+
+    uint32_t offset = 0;
+    while (offset + sizeof(struct MultibootMemoryMap) <= mmap_length) {
+        struct MultibootMemoryMap *entry = (struct MultibootMemoryMap*) (mmap_addr + offset + KERNEL_VIRTUAL_BASE);
+        if (entry->type == MULTIBOOT_MEMORY_AVAILABLE)
+            mark_usable_region(entry->base_addr, entry->length);
+        offset += entry->size + sizeof(entry->size);
+    }
+    return TRUE;
+}
+
+void initialize_page_frame_allocator(struct MultibootInfo *multiboot_info) {
+    memset(&page_driver_state, 0, sizeof(struct PageDriverState));
+
+    bool has_memory_map = multiboot_info != 0 && read_multiboot_memory_map(multiboot_info);
+    if (!has_memory_map) {
+        if (multiboot_info != 0 && (multiboot_info->flags & MULTIBOOT_INFO_MEMORY))
+            mark_usable_region(0x100000, (uint64_t) multiboot_info->mem_upper * 1024);
+        else
+            mark_usable_region(0, (uint64_t) PAGE_FRAME_FALLBACK_COUNT * PAGE_FRAME_SIZE);
+    }
+
+    // Kernel image, stack & higher half mapping live in lower frames
+    uint32_t kernel_frame_count = ((uint32_t) &_linker_kernel_physical_addr_end + PAGE_FRAME_SIZE - 1) / PAGE_FRAME_SIZE;
+    for (uint32_t frame = 0; frame < kernel_frame_count; frame++)
+        set_frame_bit(page_driver_state.frame_usable_bitmap, frame, FALSE);
+
+    for (uint32_t frame = 0; frame < PAGE_FRAME_MAX_COUNT; frame++) {
+        bool usable = is_frame_bit_set(page_driver_state.frame_usable_bitmap, frame);
+        set_frame_bit(page_driver_state.frame_used_bitmap, frame, !usable);
+        if (usable)
+            page_driver_state.usable_frame_count++;
+    }
+    page_driver_state.free_frame_count = page_driver_state.usable_frame_count;
+    page_driver_state.last_frame       = 0;
+    page_driver_state.current_directory = PAGE_DIRECTORY_KERNEL_ID;
+    page_driver_state.directory_used[PAGE_DIRECTORY_KERNEL_ID] = TRUE;
+}
+
+int8_t allocate_page_frame(void **physical_addr) {
+    if (page_driver_state.free_frame_count == 0)
+        return -1;
+
+    // Next fit, skip fully used bitmap byte
+    uint32_t frame = (page_driver_state.last_frame + 1) % PAGE_FRAME_MAX_COUNT;
+    for (uint32_t checked = 0; checked < PAGE_FRAME_MAX_COUNT; checked++) {
+        if (frame % 8 == 0 && page_driver_state.frame_used_bitmap[frame / 8] == 0xFF) {
+            checked += 7;
+            frame    = (frame + 8) % PAGE_FRAME_MAX_COUNT;
+            continue;
+        }
+        if (!is_frame_bit_set(page_driver_state.frame_used_bitmap, frame)) {
+            set_frame_bit(page_driver_state.frame_used_bitmap, frame, TRUE);
+            page_driver_state.last_frame = frame;
+            page_driver_state.free_frame_count--;
+            page_driver_state.allocate_count++;
+            *physical_addr = (void*) (frame * PAGE_FRAME_SIZE);
+            return 0;
+        }
+        frame = (frame + 1) % PAGE_FRAME_MAX_COUNT;
+    }
+    return -1;
+}
+
+int8_t free_page_frame(void *physical_addr) {
+    uint32_t addr  = (uint32_t) physical_addr;
+    uint32_t frame = addr / PAGE_FRAME_SIZE;
+    if (addr % PAGE_FRAME_SIZE != 0
+            || !is_frame_bit_set(page_driver_state.frame_usable_bitmap, frame)
+            || !is_frame_bit_set(page_driver_state.frame_used_bitmap, frame))
+        return -1;
+
+    set_frame_bit(page_driver_state.frame_used_bitmap, frame, FALSE);
+    page_driver_state.free_frame_count++;
+    page_driver_state.free_count++;
+    return 0;
+}
+
+void get_page_frame_stats(struct PageFrameStats *stats) {
+    stats->frame_size         = PAGE_FRAME_SIZE;
+    stats->usable_frame_count = page_driver_state.usable_frame_count;
+    stats->free_frame_count   = page_driver_state.free_frame_count;
+    stats->allocate_count     = page_driver_state.allocate_count;
+    stats->free_count         = page_driver_state.free_count;
+    stats->small_frame_count  = 0;
+    stats->small_page_count   = 0;
+    stats->page_table_count   = 0;
+    stats->page_fault_count   = page_driver_state.page_fault_count;
+    stats->file_page_count    = page_driver_state.file_page_count;
+    for (uint32_t i = 0; i < SMALL_PAGE_FRAME_COUNT; i++) {
+        if (page_driver_state.small_frame_addr[i] != 0) {
+            stats->small_frame_count++;
+            stats->small_page_count += page_driver_state.small_frame_used[i];
+        }
+    }
+    for (uint32_t i = 0; i < PAGE_TABLE_POOL_COUNT; i++)
+        if (page_driver_state.page_table_used[i] != 0)
+            stats->page_table_count++;
+    stats->directory_count = 0;
+    for (uint32_t i = 0; i < PAGE_DIRECTORY_COUNT; i++)
+        if (page_driver_state.directory_used[i])
+            stats->directory_count++;
+}
+
+/**
+ * Allocate PAGE_SIZE physical page, splitting new frame when every small frame is full
+ * 
+ * @param  physical_addr Pointer to store allocated page physical address
+ * @return int8_t        0 success, -1 if no page left
+ */
+static int8_t allocate_small_page(uint32_t *physical_addr) {
+    int32_t slot = -1;
+    for (uint32_t i = 0; i < SMALL_PAGE_FRAME_COUNT && slot == -1; i++)
+        if (page_driver_state.small_frame_addr[i] != 0 && page_driver_state.small_frame_used[i] < PAGE_PER_FRAME)
+            slot = i;
+
+    if (slot == -1) {
+        for (uint32_t i = 0; i < SMALL_PAGE_FRAME_COUNT && slot == -1; i++)
+            if (page_driver_state.small_frame_addr[i] == 0)
+                slot = i;
+        void *frame_addr;
+        if (slot == -1 || allocate_page_frame(&frame_addr) != 0)
+            return -1;
+        page_driver_state.small_frame_addr[slot] = (uint32_t) frame_addr;
+        page_driver_state.small_frame_used[slot] = 0;
+        memset(page_driver_state.small_page_bitmap[slot], 0, PAGE_PER_FRAME/8);
+    }
+
+    uint8_t *bitmap = page_driver_state.small_page_bitmap[slot];
+    uint32_t page = 0;
+    while (bitmap[page / 8] == 0xFF)
+        page += 8;
+    while (is_frame_bit_set(bitmap, page))
+        page++;
+
+    set_frame_bit(bitmap, page, TRUE);
+    page_driver_state.small_frame_used[slot]++;
+    *physical_addr = page_driver_state.small_frame_addr[slot] + page*PAGE_SIZE;
+    return 0;
+}
+
+/**
+ * Return PAGE_SIZE physical page, whole frame is returned to frame allocator when it become empty
+ * 
+ * @param physical_addr Physical address of page
+ */
+static void free_small_page(uint32_t physical_addr) {
+    uint32_t frame_addr = physical_addr & ~(PAGE_FRAME_SIZE - 1);
+    uint32_t page       = (physical_addr % PAGE_FRAME_SIZE) / PAGE_SIZE;
+    for (uint32_t i = 0; i < SMALL_PAGE_FRAME_COUNT; i++) {
+        if (page_driver_state.small_frame_addr[i] != frame_addr
+                || !is_frame_bit_set(page_driver_state.small_page_bitmap[i], page))
+            continue;
+
+        set_frame_bit(page_driver_state.small_page_bitmap[i], page, FALSE);
+        if (--page_driver_state.small_frame_used[i] == 0) {
+            free_page_frame((void*) frame_addr);
+            page_driver_state.small_frame_addr[i] = 0;
+        }
+        return;
+    }
+}
+
+/**
+ * Get page table referenced by page directory entry
+ * 
+ * @return int32_t Index in page_table_pool, -1 if entry is not present or mapping 4 MiB page
+ */
+static int32_t get_page_table_index(struct PageDirectoryEntry *entry) {
+    if (!entry->flag.present_bit || entry->flag.use_pagesize_4_mb)
+        return -1;
+    uint32_t table_addr = ((uint32_t) entry->lower_address << 22)
+        | ((uint32_t) entry->reserved << 21)
+        | ((uint32_t) entry->higher_address << 13)
+        | ((uint32_t) entry->page_attribute_table << 12);
+    return (table_addr + KERNEL_VIRTUAL_BASE - (uint32_t) page_table_pool) / sizeof(struct PageTable);
+}
+
+/**
+ * Point page directory entry to page table, 4 KiB PDE reuse PAT / higher_address / reserved bit as address
+ * 
+ * @param entry       Page directory entry to update
+ * @param table_index Index in page_table_pool
+ */
+static void set_page_table_entry(struct PageDirectoryEntry *entry, uint32_t table_index) {
+    uint32_t table_addr = (uint32_t) &page_table_pool[table_index] - KERNEL_VIRTUAL_BASE;
+    struct PageDirectoryEntryFlag flag = {
+        .present_bit    = 1,
+        .write_bit      = 1,
+        .supervisor_bit = 1,
+    };
+    entry->flag                 = flag;
+    entry->global_page          = 0;
+    entry->page_attribute_table = (table_addr >> 12) & 0x1;
+    entry->higher_address       = (table_addr >> 13) & 0xFF;
+    entry->reserved             = (table_addr >> 21) & 0x1;
+    entry->lower_address        = (table_addr >> 22) & 0x3FF;
+}
+
+int8_t allocate_single_user_page(void *virtual_addr) {
+    uint32_t page_index = ((uint32_t) virtual_addr >> 22) & 0x3FF;
+    uint32_t table_entry_index = ((uint32_t) virtual_addr >> 12) & 0x3FF;
+    struct PageDirectoryEntry *entry = &current_page_directory()->table[page_index];
+    if (entry->flag.present_bit && entry->flag.use_pagesize_4_mb)
+        return -1;
+
+    int32_t table_index = get_page_table_index(entry);
+    bool new_table = table_index == -1;
+    if (new_table) {
+        for (uint32_t i = 0; i < PAGE_TABLE_POOL_COUNT && table_index == -1; i++)
+            if (page_driver_state.page_table_used[i] == 0)
+                table_index = i;
+        if (table_index == -1)
+            return -1;
+    }
+
+    uint32_t physical_addr;
+    if (allocate_small_page(&physical_addr) != 0)
+        return -1;
+
+    struct PageTableEntry *table_entry = &page_table_pool[table_index].table[table_entry_index];
+    if (new_table) {
+        memset(&page_table_pool[table_index], 0, sizeof(struct PageTable));
+        set_page_table_entry(entry, table_index);
+    } else if (table_entry->present_bit) {
+        // Remapping user page, release previous page
+        free_small_page(table_entry->address << 12);
+        page_driver_state.page_table_used[table_index]--;
+    }
+
+    table_entry->address        = physical_addr >> 12;
+    table_entry->present_bit    = 1;
+    table_entry->write_bit      = 1;
+    table_entry->supervisor_bit = 1;
+    page_driver_state.page_table_used[table_index]++;
+
+    uint8_t *page_addr = (uint8_t*) ((uint32_t) virtual_addr & ~(PAGE_SIZE - 1));
+    flush_single_tlb(page_addr);
+    memset(page_addr, 0, PAGE_SIZE);
+    return 0;
+}
+
+int8_t free_single_user_page(void *virtual_addr) {
+    uint32_t page_index = ((uint32_t) virtual_addr >> 22) & 0x3FF;
+    uint32_t table_entry_index = ((uint32_t) virtual_addr >> 12) & 0x3FF;
+    struct PageDirectoryEntry *entry = &current_page_directory()->table[page_index];
+    int32_t table_index = get_page_table_index(entry);
+    if (table_index == -1)
+        return -1;
+
+    struct PageTableEntry *table_entry = &page_table_pool[table_index].table[table_entry_index];
+    if (!table_entry->present_bit)
+        return -1;
+
+    free_small_page(table_entry->address << 12);
+    struct PageTableEntry empty_entry = {0};
+    *table_entry = empty_entry;
+    if (--page_driver_state.page_table_used[table_index] == 0) {
+        struct PageDirectoryEntry empty_directory_entry = {0};
+        *entry = empty_directory_entry;
+    }
+    flush_single_tlb(virtual_addr);
+    return 0;
+}
+
+int8_t allocate_user_pages(void *virtual_addr, uint32_t size) {
+    uint32_t addr = (uint32_t) virtual_addr & ~(PAGE_SIZE - 1);
+    uint32_t end  = (uint32_t) virtual_addr + size;
+    for (; addr < end; addr += PAGE_SIZE)
+        if (allocate_single_user_page((void*) addr) != 0)
+            return -1;
+    return 0;
+}
+
+static bool is_user_page_present(uint32_t virtual_addr) {
+    struct PageDirectoryEntry *entry = &current_page_directory()->table[(virtual_addr >> 22) & 0x3FF];
+    int32_t table_index = get_page_table_index(entry);
+    return table_index != -1 && page_table_pool[table_index].table[(virtual_addr >> 12) & 0x3FF].present_bit;
+}
+
+static struct UserPageRegion *find_user_page_region(uint32_t virtual_addr) {
+    for (uint32_t i = 0; i < USER_REGION_COUNT; i++) {
+        struct UserPageRegion *region = &current_user_region()[i];
+        if (region->size != 0 && virtual_addr >= region->virtual_addr && virtual_addr - region->virtual_addr < region->size)
+            return region;
+    }
+    return 0;
+}
+
+/**
+ * Allocate zero-filled page at virtual_addr and read its file backed part
+ * 
+ * @param  region    Region containing page
+ * @param  page_addr PAGE_SIZE aligned virtual address
+ * @return int8_t    0 success, -1 if out of memory or backing file cannot be read
+ */
+static int8_t populate_user_page(struct UserPageRegion *region, uint32_t page_addr) {
+    if (allocate_single_user_page((void*) page_addr) != 0)
+        return -1;
+    page_driver_state.page_fault_count++;
+
+    uint32_t offset = page_addr - region->virtual_addr;
+    if (offset >= region->file_size)
+        return 0;
+
+    struct FAT32DriverRequest request = {
+        .buf                   = (void*) page_addr,
+        .parent_cluster_number = region->parent_cluster_number,
+        .buffer_size           = region->file_size - offset < PAGE_SIZE ? region->file_size - offset : PAGE_SIZE,
+        .offset                = offset,
+    };
+    memcpy(request.name, region->name, 8);
+    memcpy(request.ext, region->ext, 3);
+    uint32_t transferred;
+    if (read_range(request, &transferred) != 0) {
+        free_single_user_page((void*) page_addr);
+        return -1;
+    }
+    page_driver_state.file_page_count++;
+    return 0;
+}
+
+int8_t add_user_page_region(struct UserPageRegion region) {
+    uint32_t end = region.virtual_addr + region.size;
+    if (region.size == 0 || region.virtual_addr % PAGE_SIZE != 0 || end < region.virtual_addr
+            || end > KERNEL_VIRTUAL_BASE || region.file_size > region.size)
+        return -1;
+
+    int32_t slot = -1;
+    for (uint32_t i = 0; i < USER_REGION_COUNT; i++) {
+        struct UserPageRegion *other = &current_user_region()[i];
+        if (other->size == 0) {
+            if (slot == -1)
+                slot = i;
+        } else if (region.virtual_addr < other->virtual_addr + other->size && other->virtual_addr < end) {
+            return -1;
+        }
+    }
+    if (slot == -1)
+        return -1;
+
+    current_user_region()[slot] = region;
+    return 0;
+}
+
+void clear_user_page_regions(void) {
+    for (uint32_t i = 0; i < USER_REGION_COUNT; i++) {
+        struct UserPageRegion *region = &current_user_region()[i];
+        for (uint32_t offset = 0; offset < region->size; offset += PAGE_SIZE)
+            if (is_user_page_present(region->virtual_addr + offset))
+                free_single_user_page((void*) (region->virtual_addr + offset));
+        region->size = 0;
+    }
+}
+
+bool handle_page_fault(void *fault_addr, uint32_t error_code) {
+    // Protection violation on present page is not resolvable
+    if (error_code & PAGE_FAULT_PRESENT_BIT)
+        return FALSE;
+
+    struct UserPageRegion *region = find_user_page_region((uint32_t) fault_addr);
+    if (region == 0)
+        return FALSE;
+    return populate_user_page(region, (uint32_t) fault_addr & ~(PAGE_SIZE - 1)) == 0;
+}
+
+void populate_user_range(void *virtual_addr, uint32_t size) {
+    uint32_t start = (uint32_t) virtual_addr & ~(PAGE_SIZE - 1);
+    uint32_t end   = (uint32_t) virtual_addr + size;
+    if (end < start)
+        end = KERNEL_VIRTUAL_BASE;
+
+    // Only walk part of range that intersect registered region
+    for (uint32_t i = 0; i < USER_REGION_COUNT; i++) {
+        struct UserPageRegion *region = &current_user_region()[i];
+        uint32_t region_end = region->virtual_addr + region->size;
+        uint32_t addr  = start > region->virtual_addr ? start : region->virtual_addr;
+        uint32_t limit = end < region_end ? end : region_end;
+        for (; addr < limit; addr += PAGE_SIZE)
+            if (!is_user_page_present(addr))
+                populate_user_page(region, addr);
+    }
+}
+
+void populate_user_string(const char *string) {
+    for (uint32_t addr = (uint32_t) string; addr < KERNEL_VIRTUAL_BASE; ) {
+        uint32_t page_end = (addr & ~(PAGE_SIZE - 1)) + PAGE_SIZE;
+        populate_user_range((void*) addr, page_end - addr);
+        if (!is_user_page_present(addr))
+            return;
+        for (; addr < page_end; addr++)
+            if (*(const char*) addr == '\0')
+                return;
+    }
+}
 
 void update_page_directory_entry(void *physical_addr, void *virtual_addr, struct PageDirectoryEntryFlag flag) {
     uint32_t page_index = ((uint32_t) virtual_addr >> 22) & 0x3FF;
+    struct PageDirectoryEntry entry = {
+        .flag          = flag,
+        .global_page   = page_index >= PAGE_DIRECTORY_KERNEL_INDEX && flag.present_bit,
+        .lower_address = ((uint32_t)physical_addr >> 22) & 0x3FF,
+    };
 
-    _paging_kernel_page_directory.table[page_index].flag          = flag;
-    _paging_kernel_page_directory.table[page_index].lower_address = ((uint32_t)physical_addr >> 22) & 0x3FF;
+    if (page_index >= PAGE_DIRECTORY_KERNEL_INDEX) {
+        // Kernel mapping is shared, keep every page directory in sync
+        for (uint32_t i = 0; i < PAGE_DIRECTORY_COUNT; i++)
+            if (page_driver_state.directory_used[i] || i == PAGE_DIRECTORY_KERNEL_ID)
+                get_page_directory(i)->table[page_index] = entry;
+    } else {
+        current_page_directory()->table[page_index] = entry;
+    }
     flush_single_tlb(virtual_addr);
 }
 
-int8_t allocate_single_user_page_frame(void *virtual_addr) {
-    // Using default QEMU config (128 MiB max memory)
-    uint32_t last_physical_addr = (uint32_t) page_driver_state.last_available_physical_addr;
+int8_t create_page_directory(uint32_t *directory_id) {
+    for (uint32_t i = 1; i < PAGE_DIRECTORY_COUNT; i++) {
+        if (page_driver_state.directory_used[i])
+            continue;
+
+        struct PageDirectory *directory = get_page_directory(i);
+        memset(directory->table, 0, PAGE_DIRECTORY_KERNEL_INDEX*sizeof(struct PageDirectoryEntry));
+        memcpy(&directory->table[PAGE_DIRECTORY_KERNEL_INDEX], &_paging_kernel_page_directory.table[PAGE_DIRECTORY_KERNEL_INDEX],
+            (PAGE_ENTRY_COUNT - PAGE_DIRECTORY_KERNEL_INDEX)*sizeof(struct PageDirectoryEntry));
+        memset(page_driver_state.user_region[i], 0, sizeof(page_driver_state.user_region[i]));
+        page_driver_state.directory_used[i] = TRUE;
+        *directory_id = i;
+        return 0;
+    }
+    return -1;
+}
+
+int8_t switch_page_directory(uint32_t directory_id) {
+    if (directory_id >= PAGE_DIRECTORY_COUNT || !page_driver_state.directory_used[directory_id])
+        return -1;
 
-    // Available physical address yang bisa dimap oleh mapper ini
-    uint32_t next_physical_addr = last_physical_addr + PAGE_FRAME_SIZE;
+    page_driver_state.current_directory = directory_id;
+    // Non-global user entry is flushed, kernel entry stay in TLB with CR4.PGE
+    uint32_t physical_addr = (uint32_t) get_page_directory(directory_id) - KERNEL_VIRTUAL_BASE;
+    __asm__ volatile("mov %0, %%cr3" : /* <Empty> */ : "r"(physical_addr) : "memory");
+    return 0;
+}
 
-    if (next_physical_addr >= (128 * 1024 * 1024)) {
+int8_t destroy_page_directory(uint32_t directory_id) {
+    if (directory_id == PAGE_DIRECTORY_KERNEL_ID || directory_id >= PAGE_DIRECTORY_COUNT
+            || directory_id == page_driver_state.current_directory || !page_driver_state.directory_used[directory_id])
         return -1;
+
+    // Directory is not loaded, user half can be released without TLB flush
+    struct PageDirectory *directory = get_page_directory(directory_id);
+    for (uint32_t page_index = 0; page_index < PAGE_DIRECTORY_KERNEL_INDEX; page_index++) {
+        struct PageDirectoryEntry *entry = &directory->table[page_index];
+        if (!entry->flag.present_bit)
+            continue;
+        if (entry->flag.use_pagesize_4_mb) {
+            free_page_frame((void*) ((uint32_t) entry->lower_address << 22));
+        } else {
+            int32_t table_index = get_page_table_index(entry);
+            for (uint32_t i = 0; i < PAGE_ENTRY_COUNT; i++)
+                if (page_table_pool[table_index].table[i].present_bit)
+                    free_small_page(page_table_pool[table_index].table[i].address << 12);
+            page_driver_state.page_table_used[table_index] = 0;
+        }
     }
+    memset(page_driver_state.user_region[directory_id], 0, sizeof(page_driver_state.user_region[directory_id]));
+    page_driver_state.directory_used[directory_id] = FALSE;
+    return 0;
+}
+
+int8_t allocate_single_user_page_frame(void *virtual_addr) {
+    uint32_t page_index = ((uint32_t) virtual_addr >> 22) & 0x3FF;
+    struct PageDirectoryEntryFlag current_flag = current_page_directory()->table[page_index].flag;
+    if (current_flag.present_bit && !current_flag.use_pagesize_4_mb)
+        return -1;
 
-    uint8_t *physical_addr = (uint8_t*) last_physical_addr;
-    page_driver_state.last_available_physical_addr += PAGE_FRAME_SIZE;
+    void *physical_addr;
+    if (allocate_page_frame(&physical_addr) != 0)
+        return -1;
+
+    // Remapping user page, release previous frame
+    free_single_user_page_frame(virtual_addr);
 
     // Update flags
     struct PageDirectoryEntryFlag flags = {
@@ -55,6 +583,20 @@ int8_t allocate_single_user_page_frame(void *virtual_addr) {
 
     return 0;
 }
+
+int8_t free_single_user_page_frame(void *virtual_addr) {
+    uint32_t page_index = ((uint32_t) virtual_addr >> 22) & 0x3FF;
+    struct PageDirectoryEntry *entry = &current_page_directory()->table[page_index];
+    if (!entry->flag.present_bit || !entry->flag.supervisor_bit || !entry->flag.use_pagesize_4_mb)
+        return -1;
+
+    void *physical_addr = (void*) ((uint32_t) entry->lower_address << 22);
+    struct PageDirectoryEntryFlag empty_flag = {0};
+    update_page_directory_entry(0, virtual_addr, empty_flag);
+    free_page_frame(physical_addr);
+    return 0;
+}
+
 void flush_single_tlb(void *virtual_addr) {
     asm volatile("invlpg (%0)" : /* <Empty> */ : "b"(virtual_addr): "memory");
 }
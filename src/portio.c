@@ -39,4 +39,21 @@ void out16(uint16_t port, uint16_t data) {
         : // <Empty output operand>
         : "a"(data), "Nd"(port)
         );
+}
+
+uint32_t in32(uint16_t port) {
+    uint32_t result;
+    __asm__ volatile(
+        "inl %1, %0"
+        : "=a"(result)
+        : "Nd"(port));
+    return result;
+}
+
+void out32(uint16_t port, uint32_t data) {
+    __asm__ volatile(
+        "outl %0, %1"
+        : // <Empty output operand>
+        : "a"(data), "Nd"(port)
+        );
 }
\ No newline at end of file
@@ -85,141 +85,86 @@ int remove(char* argument1) {
 
 
 
-int cd(char* argument1, int argument1_length) {
-    int ret;
-    uint32_t retcode = 0;
-    struct FAT32DriverRequest request;
-    if (memcmp("..", argument1, 2) == 0 && argument1_length == 2) {
-        request.parent_cluster_number = cwd_cluster_number;
-        if (cwd_cluster_number != ROOT_CLUSTER_NUMBER) {
-            syscall(10, (uint32_t) &request, (uint32_t) &retcode, 0);
-            cwd_cluster_number = retcode;
-            ret = 1;
-        }
-    } else {
-        request.buffer_size = BUFFER_SIZE;
-        request.buf = request_buf;
-        memcpy(request.name, argument1, argument1_length);
-        int idx = argument1_length;
-        while (idx <= 7) {
-            request.name[idx] = '\0';
-            idx++;
-        }
-        memcpy(request.ext, "dir", 3);
-        request.parent_cluster_number = cwd_cluster_number;
-        syscall(1, (uint32_t) &request, (uint32_t) &retcode, 0);
-        if (retcode == RD_REQUEST_SUCCESS_RETURN) {
-            syscall(9, (uint32_t) &request, (uint32_t) &retcode, 0);
-            cwd_cluster_number = retcode;
-            ret = 1;
-        } else if (retcode == RD_REQUEST_NOT_FOUND_RETURN) {
-            ret = 0;
-        } else if (retcode == RD_REQUEST_NOT_A_FOLDER_RETURN){
-            ret = 0;
-        }
-    }
-    return ret;
-}
-
 int relative_cd(char* argument1, int argument1_length) {
-    char *arg = argument1;
-    int len = 0;
-    if (argument1_length == 0) {
+    // Whole path resolved by kernel in single syscall
+    char path[KEYBOARD_BUFFER_SIZE] = {0};
+    uint32_t cluster = 0;
+    if (argument1_length == 0 || argument1[argument1_length - 1] == '/') {
         return 0;
     }
-    if (*(arg + argument1_length - 1) == '/') {
+    memcpy(path, argument1, argument1_length);
+    syscall(15, (uint32_t) path, cwd_cluster_number, (uint32_t) &cluster);
+    if (cluster == 0) {
         return 0;
     }
-    int ret;
-    for (int i = 0; i < argument1_length; i++) {
-        if (*(arg + len) == '/') {
-            ret = cd(arg, len);
-            if (!ret) return 0;
-            arg = arg + len + 1;
-            len = 0;
-        } else {
-            len++;
-        }
-    }
-    return cd(arg, len);
+    cwd_cluster_number = cluster;
+    return 1;
 }
 
-int copy(char* argument1, char* argument2, int mv) {
-    char file_buffer[BUFFER_SIZE];
-    char* arg = argument1;
-    request.buffer_size = BUFFER_SIZE;
-    request.buf = file_buffer;
-    request.parent_cluster_number = cwd_cluster_number;
+// Fill 8.3 name of request from "name.ext" word, word without '.' has empty ext
+void set_request_name(char* arg) {
     int i;
-    for (i = 0; i < 8 && *arg != '.' && *arg != '\n'; i++) {
+    for (i = 0; i < 8 && *arg != '.' && *arg != '\n' && *arg != ' '; i++) {
         request.name[i] = *arg++;
     }
     memset(request.name + i, 0, 8 - i);
-    arg++;
-    for (i = 0; i < 3 && *arg != ' ' && *arg != '\n'; i++) {
-        request.ext[i] = *arg++;  
-    }
-    memset(request.name + i, 0, 3 - i);
-    int retcode;
-    syscall(0, (uint32_t) &request, (uint32_t) &retcode, 0);
-    if (retcode != R_REQUEST_SUCCESS_RETURN) {
-        return 0;
+    memset(request.ext, 0, 3);
+    if (*arg == '.') {
+        arg++;
+        for (i = 0; i < 3 && *arg != ' ' && *arg != '\n'; i++) {
+            request.ext[i] = *arg++;
+        }
     }
+}
 
+// Point request at destination of cp / mv: existing directory keep source name, else last path component is new name
+int set_dest_request(char* argument2) {
     uint32_t temp_cwd = cwd_cluster_number;
-    char *last_path = argument2;
-    int is_path_valid;
-    if (!mv) {
+    if (!relative_cd(argument2, length(argument2))) {
+        char *last_path = argument2;
         for (int i = 0; i < length(argument2); i++) {
             if (argument2[i] == '/') 
                 last_path = argument2 + i + 1;
         }
-        is_path_valid = relative_cd(argument2, length(argument2) - length(last_path) - 1) 
-            || length(argument2) == length(last_path);
-        if (!is_path_valid) {
-            cwd_cluster_number = temp_cwd;
-            return -1;
-        }
-    } else {
-        is_path_valid = relative_cd(argument2, length(argument2)) 
+        int is_path_valid = relative_cd(argument2, length(argument2) - length(last_path) - 1) 
             || length(argument2) == length(last_path);
         if (!is_path_valid) {
             cwd_cluster_number = temp_cwd;
-            return -1;
+            return 0;
         }
+        set_request_name(last_path);
     }
+    request.parent_cluster_number = cwd_cluster_number;
+    cwd_cluster_number = temp_cwd;
+    return 1;
+}
 
-    if (!mv) {
-        arg = last_path;
-        for (i = 0; i < 8 && *arg != '.' && *arg != '\n'; i++) {
-            request.name[i] = *arg++;
-        }
-        memset(request.name + i, 0, 8 - i);
-        arg++;
-        for (i = 0; i < 3 && *arg != ' ' && *arg != '\n'; i++) {
-            request.ext[i] = *arg++;  
-        }
-        memset(request.name + i, 0, 3 - i);
-    } else {
-        arg = argument1;
-        for (i = 0; i < 8 && *arg != '.' && *arg != '\n'; i++) {
-            request.name[i] = *arg++;
-        }
-        memset(request.name + i, 0, 8 - i);
-        arg++;
-        for (i = 0; i < 3 && *arg != ' ' && *arg != '\n'; i++) {
-            request.ext[i] = *arg++;  
-        }
-        memset(request.name + i, 0, 3 - i);
+int move(char* argument1, char* argument2) {
+    set_request_name(argument1);
+    request.parent_cluster_number = cwd_cluster_number;
+    struct FAT32DriverRequest source = request;
+    if (!set_dest_request(argument2)) {
+        return MV_REQUEST_INVALID_PARENT_RETURN;
     }
-    request.buf = file_buffer;
+
+    // Entry is moved in place by kernel, no data is copied
+    int8_t retcode;
+    syscall(26, (uint32_t) &source, (uint32_t) &request, (uint32_t) &retcode);
+    return retcode;
+}
+
+int copy(char* argument1, char* argument2) {
+    set_request_name(argument1);
     request.parent_cluster_number = cwd_cluster_number;
-    syscall(2, (uint32_t) &request, (uint32_t) &retcode, 0);
-    if (retcode != W_REQUEST_SUCCESS_RETURN) {
-        return 1;
+    struct FAT32DriverRequest source = request;
+    if (!set_dest_request(argument2)) {
+        return CP_REQUEST_INVALID_PARENT_RETURN;
     }
-    cwd_cluster_number = temp_cwd;
-    return 1;
+
+    // Copy share source cluster, only metadata is written
+    int8_t retcode;
+    syscall(27, (uint32_t) &source, (uint32_t) &request, (uint32_t) &retcode);
+    return retcode;
 }
 
 int main(void) {
@@ -253,11 +198,18 @@ int main(void) {
                 print(": No such file or directory\n", BIOS_WHITE);
             }
         } else if (memcmp(command, "ls", 2) == 0 && !argument1_length) {
-            syscall(8, (uint32_t) request_buf, cwd_cluster_number, 0);
-            if (request_buf[0] == 0) {
+            // Directory may span several cluster, list it batch by batch
+            uint32_t cursor = 0;
+            bool is_empty   = TRUE;
+            do {
+                syscall(8, (uint32_t) request_buf, cwd_cluster_number, (uint32_t) &cursor);
+                if (request_buf[0] != 0) {
+                    is_empty = FALSE;
+                    print(request_buf, BIOS_WHITE);
+                }
+            } while (cursor != 0);
+            if (is_empty) {
                 print("DIRECTORY EMPTY\n", BIOS_LIGHT_BLUE);
-            } else {
-                print(request_buf, BIOS_WHITE);
             }
         } else if (memcmp(command, "mkdir", 5) == 0 && argument1_length != 0) {
             uint32_t retcode;
@@ -295,31 +247,50 @@ int main(void) {
             for (i = 0; i < 3 && *arg != ' ' && *arg != '\n'; i++) {
                 request.ext[i] = *arg++;  
             }
-            memset(request.name + i, 0, 3 - i);
-            int retcode;
-            syscall(0, (uint32_t) &request, (uint32_t) &retcode, 0);
-            print("cat: ", BIOS_WHITE);
-            syscall(5, (uint32_t) argument1, (uint32_t) argument1_length, BIOS_WHITE);
-            print(": ", BIOS_WHITE);
-            if (retcode == R_NOT_ENOUGH_BUFFER_RETURN) {
-                print("File size is too large\n", BIOS_WHITE);
-            } else if (retcode == R_REQUEST_NOT_A_FILE_RETURN) {
+            memset(request.ext + i, 0, 3 - i);
+            // Stream file with small buffer through open handle, entry is resolved once
+            int8_t   retcode;
+            uint32_t transferred = 0;
+            int32_t  fd;
+            syscall(21, (uint32_t) &request, (uint32_t) &retcode, (uint32_t) &fd);
+            if (retcode != R_REQUEST_SUCCESS_RETURN) {
+                print("cat: ", BIOS_WHITE);
+                syscall(5, (uint32_t) argument1, (uint32_t) argument1_length, BIOS_WHITE);
+                print(": ", BIOS_WHITE);
+            }
+            if (retcode == R_REQUEST_NOT_A_FILE_RETURN) {
                 print("Is a directory\n", BIOS_WHITE);
             } else if (retcode == R_REQUEST_NOT_FOUND_RETURN) {
                 print("No such file or directory\n", BIOS_WHITE);
             } else if (retcode == R_REQUEST_UNKNOWN_RETURN) {
                 print("Unknown error occurs\n", BIOS_LIGHT_RED);
             } else {
-                syscall(7, (uint32_t) request_buf, BUFFER_SIZE, 0);
+                // read_file stop at exact file size
+                struct FileIORequest io = {0};
+                io.fd   = fd;
+                io.buf  = request_buf;
+                io.size = BUFFER_SIZE;
+                syscall(22, (uint32_t) &io, (uint32_t) &retcode, (uint32_t) &transferred);
+                while (transferred > 0) {
+                    syscall(5, (uint32_t) request_buf, transferred, BIOS_WHITE);
+                    syscall(22, (uint32_t) &io, (uint32_t) &retcode, (uint32_t) &transferred);
+                }
+                syscall(25, (uint32_t) &io, (uint32_t) &retcode, 0);
+                print("\n", BIOS_WHITE);
             }
         } else if (memcmp(command, "cp", 2) == 0 && argument1_length != 0) {
-            int retcode = copy(argument1, argument2 , 0);
-            if (retcode != 1) {
-                syscall(0, (uint32_t) &request, (uint32_t) &retcode, 0);
+            int retcode = copy(argument1, argument2);
+            if (retcode != CP_REQUEST_SUCCESS_RETURN) {
                 print("cp: ", BIOS_WHITE);
-                if (retcode == -1) {
+                if (retcode == CP_REQUEST_NOT_FOUND_RETURN) {
                     syscall(5, (uint32_t) argument1, (uint32_t) argument1_length, BIOS_WHITE);
-                    print(": Error while reading source\n", BIOS_WHITE);
+                    print(": No such file or directory\n", BIOS_WHITE);
+                } else if (retcode == CP_REQUEST_ALREADY_EXIST_RETURN) {
+                    syscall(5, (uint32_t) argument2, (uint32_t) argument2_length, BIOS_WHITE);
+                    print(": File exists\n", BIOS_WHITE);
+                } else if (retcode == CP_REQUEST_INTO_ITSELF_RETURN) {
+                    syscall(5, (uint32_t) argument2, (uint32_t) argument2_length, BIOS_WHITE);
+                    print(": Cannot copy directory into itself\n", BIOS_WHITE);
                 } else {
                     syscall(5, (uint32_t) argument2, (uint32_t) argument2_length, BIOS_WHITE);
                     print(": Error while writing dest\n", BIOS_WHITE);
@@ -345,65 +316,68 @@ int main(void) {
             }
            
         } else if (memcmp(command, "mv", 2) == 0 && *argument1) {
-            int retcode = copy(argument1, argument2, 1);
-             if (retcode != 1) {
-                syscall(0, (uint32_t) &request, (uint32_t) &retcode, 0);
+            int retcode = move(argument1, argument2);
+            if (retcode != MV_REQUEST_SUCCESS_RETURN) {
                 print("mv: ", BIOS_WHITE);
-                if (retcode == -1) {
+                if (retcode == MV_REQUEST_NOT_FOUND_RETURN) {
                     syscall(5, (uint32_t) argument1, (uint32_t) argument1_length, BIOS_WHITE);
-                    print(": Error while reading source\n", BIOS_WHITE);
-                    continue;
+                    print(": No such file or directory\n", BIOS_WHITE);
+                } else if (retcode == MV_REQUEST_ALREADY_EXIST_RETURN) {
+                    syscall(5, (uint32_t) argument2, (uint32_t) argument2_length, BIOS_WHITE);
+                    print(": File exists\n", BIOS_WHITE);
+                } else if (retcode == MV_REQUEST_INTO_ITSELF_RETURN) {
+                    syscall(5, (uint32_t) argument2, (uint32_t) argument2_length, BIOS_WHITE);
+                    print(": Cannot move directory into itself\n", BIOS_WHITE);
                 } else {
                     syscall(5, (uint32_t) argument2, (uint32_t) argument2_length, BIOS_WHITE);
                     print(": Error while writing dest\n", BIOS_WHITE);
-                    continue;
                 }
             }
-            retcode = remove(argument1);
-            if (retcode == D_FOLDER_NOT_EMPTY_RETURN) {
-                continue;
-            } else if (retcode == D_REQUEST_NOT_FOUND_RETURN) {
-                continue;
-            } else if (retcode == D_REQUEST_SUCCESS_RETURN) {
-                continue;
-            } else if (retcode == D_REQUEST_UNKNOWN_RETURN) {
-                continue;
-            }
         } else if (memcmp(command, "whereis", 7) == 0) {
-            char* arg = argument1;
-            request.buffer_size = BUFFER_SIZE;
-            request.buf = request_buf;
-            request.parent_cluster_number = cwd_cluster_number;
-            int i;
-            for (i = 0; i < 8 && *arg != '.' && *arg != '\n'; i++) {
-                request.name[i] = *arg++;
-            }
-            memset(request.name + i, 0, 8 - i);
-            bool ext = *arg++ == '.';
-            if (ext) {
-                for (i = 0; i < 3 && *arg != ' ' && *arg != '\n'; i++) {
-                    request.ext[i] = *arg++;  
-                }
-                memset(request.name + i, 0, 3 - i);
-            } else {
-                memcpy(request.ext, "dir", 3);
-            }
-            int retcode;
-            request.buf = request_buf;
-            syscall(12, (uint32_t) &request, (uint32_t) &retcode, 0);
+            // Argument is pattern "name.ext" or "name", may contain '*' and '?'
+            char pattern[KEYBOARD_BUFFER_SIZE] = {0};
+            memcpy(pattern, argument1, argument1_length);
+            struct IndexEntry *found = (struct IndexEntry*) request_buf;
+            uint32_t found_count     = BUFFER_SIZE / sizeof(struct IndexEntry);
+            syscall(14, (uint32_t) pattern, (uint32_t) found, (uint32_t) &found_count);
             syscall(5, (uint32_t) argument1, (uint32_t) argument1_length, BIOS_WHITE);
-            memset(request_buf + 3 * CLUSTER_SIZE, 0, CLUSTER_SIZE);
-            memcpy(request_buf + 3 * CLUSTER_SIZE, argument1, argument1_length);
             print(": ", BIOS_WHITE);
-            for (int i = 0; i < retcode; i++) {
-                char path [KEYBOARD_BUFFER_SIZE];
-                print("/", BIOS_WHITE);
-                syscall(6, (uint32_t) path, *(((uint32_t *) request_buf) + i), 0);
-                print(path, BIOS_WHITE);
-                memset(request_buf + CLUSTER_SIZE, 0, CLUSTER_SIZE);
-                print("/", BIOS_WHITE);
-                print(request_buf + 3 * CLUSTER_SIZE, BIOS_WHITE);
-                print("  ", BIOS_WHITE);
+            // Resolve every parent directory path with batch syscall
+            uint32_t parents[BUFFER_SIZE / sizeof(struct IndexEntry)];
+            char     paths[BUFFER_SIZE];
+            for (uint32_t i = 0; i < found_count; i++)
+                parents[i] = found[i].parent_cluster_number;
+            uint32_t done = 0;
+            while (done < found_count) {
+                struct DirPathBatchRequest batch = {
+                    .clusters    = parents + done,
+                    .count       = found_count - done,
+                    .buf         = paths,
+                    .buffer_size = BUFFER_SIZE,
+                };
+                uint32_t resolved = 0;
+                syscall(16, (uint32_t) &batch, (uint32_t) &resolved, 0);
+                if (resolved == 0)
+                    break;
+                char *path = paths;
+                for (uint32_t i = done; i < done + resolved; i++) {
+                    char name[8 + 1 + 3 + 1] = {0};
+                    int  name_length = 0;
+                    for (int j = 0; j < 8 && found[i].name[j] != '\0'; j++)
+                        name[name_length++] = found[i].name[j];
+                    if (found[i].ext[0] != '\0') {
+                        name[name_length++] = '.';
+                        for (int j = 0; j < 3 && found[i].ext[j] != '\0'; j++)
+                            name[name_length++] = found[i].ext[j];
+                    }
+                    print("/", BIOS_WHITE);
+                    print(path, BIOS_WHITE);
+                    print("/", BIOS_WHITE);
+                    print(name, BIOS_WHITE);
+                    print("  ", BIOS_WHITE);
+                    while (*path++ != '\0');
+                }
+                done += resolved;
             }
             print("\n", BIOS_WHITE);
         } else if (memcmp(command, "clear", 5) == 0) {